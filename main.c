@@ -6,11 +6,15 @@
 #include <wincon.h>
 #include <time.h>
 #include <stdbool.h>
+#include <stddef.h>
 
 // func declarations
 void refreshScreen();
 int readKey();
 void setStatusMessage(const char* fmt, ...);
+void moveCursor(int key);
+void layoutViews();
+void initViews();
 
 void die(const char *s, ...);
 
@@ -19,6 +23,14 @@ void die(const char *s, ...);
 #define SB_INIT &(struct StringBuilder){.chars = NULL, .len = 0}
 #define TAB_LENGTH 4
 #define QUIT_CONFIRMATION 2
+#define SLAB_MIN_SIZE 16
+#define SLAB_CLASSES 9 // 16 bytes up to 4KB, longer lines go straight to the heap
+#define SLAB_PAGE_SIZE (64 * 1024)
+#define REGEX_MAX_DFA_STATES 1024 // cached per dfa before the cache is thrown away and rebuilt
+#define REGEX_DFA_TABLE_SIZE 2048 // power of two, at least REGEX_MAX_DFA_STATES
+#define MAX_THREADS 16
+#define SEARCH_PARALLEL_LINES 20000 // smaller buffers aren't worth starting threads for
+#define SORT_PARALLEL_LINES 100000
 
 enum SpecialKeys
 {
@@ -33,7 +45,8 @@ enum SpecialKeys
 	DELETE_KEY,
 	ENTER_KEY,
 	BACKSPACE,
-	ESCAPE_KEY
+	ESCAPE_KEY,
+	CTRL_SPACE
 };
 
 int clamp(int *val, int min, int max)
@@ -48,6 +61,133 @@ void resetScreen()
 	WriteConsoleA(stdOut, "\x1b[2J\x1b[H", 7, NULL, NULL);
 }
 
+/*** MEMORY ACCOUNTING ***/
+// every allocation goes through here with the subsystem it belongs to, a small header in front of each block
+// remembers its size and tag so frees can be credited back without the caller knowing either
+enum MemoryTag
+{
+	MEM_LINES,
+	MEM_RENDER,
+	MEM_SCREEN,
+	MEM_PROMPT,
+	MEM_FILE,
+	MEM_CURSORS,
+	MEM_SEARCH,
+	MEM_INDEX,
+	MEM_COMMANDS,
+	MEM_VIEWS,
+	MEM_TAGS
+};
+
+const char *memory_tag_names[MEM_TAGS] = {"lines", "render", "screen", "prompt", "file", "cursors", "search", "index", "commands", "views"};
+
+// swap these out to put a different heap under the whole editor
+typedef struct Allocator
+{
+	void *(*alloc)(size_t size);
+	void *(*resize)(void *ptr, size_t size);
+	void (*release)(void *ptr);
+} Allocator;
+
+typedef union MemoryHeader
+{
+	struct
+	{
+		size_t size;
+		int tag;
+	};
+	max_align_t align;
+} MemoryHeader;
+
+// search and filter threads allocate too, so counters are only touched with interlocked adds
+struct
+{
+	Allocator allocator;
+	volatile LONG64 bytes[MEM_TAGS], peak[MEM_TAGS], calls[MEM_TAGS], frees[MEM_TAGS];
+	volatile LONG64 total, total_peak;
+	bool overlay; // show the counters in the editor bar
+	bool report; // print them when the editor exits, set by --stats
+} memory = {.allocator = {malloc, realloc, free}, .overlay = false, .report = false};
+
+void countMemory(int tag, LONG64 delta, bool call)
+{
+	LONG64 bytes = InterlockedExchangeAdd64(&memory.bytes[tag], delta) + delta;
+	LONG64 total = InterlockedExchangeAdd64(&memory.total, delta) + delta;
+	if (call)
+		InterlockedExchangeAdd64(&memory.calls[tag], 1);
+	// peaks can race with another thread, being off by one allocation is fine for a report
+	if (bytes > memory.peak[tag])
+		memory.peak[tag] = bytes;
+	if (total > memory.total_peak)
+		memory.total_peak = total;
+}
+
+void *memAlloc(int tag, size_t size)
+{
+	MemoryHeader *header = memory.allocator.alloc(sizeof(MemoryHeader) + size);
+	if (header == NULL)
+		return NULL;
+	header->size = size;
+	header->tag = tag;
+	countMemory(tag, size, true);
+	return header + 1;
+}
+
+void *memCalloc(int tag, size_t count, size_t size)
+{
+	void *ptr = memAlloc(tag, count * size);
+	if (ptr)
+		memset(ptr, 0, count * size);
+	return ptr;
+}
+
+void *memRealloc(int tag, void *ptr, size_t size)
+{
+	if (ptr == NULL)
+		return memAlloc(tag, size);
+	MemoryHeader *header = (MemoryHeader *)ptr - 1;
+	size_t old_size = header->size;
+	tag = header->tag; // blocks stay with the subsystem that first allocated them
+	if ((header = memory.allocator.resize(header, sizeof(MemoryHeader) + size)) == NULL)
+		return NULL;
+	header->size = size;
+	countMemory(tag, (LONG64)size - (LONG64)old_size, true);
+	return header + 1;
+}
+
+void memFree(void *ptr)
+{
+	if (ptr == NULL)
+		return;
+	MemoryHeader *header = (MemoryHeader *)ptr - 1;
+	countMemory(header->tag, -(LONG64)header->size, false);
+	InterlockedExchangeAdd64(&memory.frees[header->tag], 1);
+	memory.allocator.release(header);
+}
+
+char *memStrdup(int tag, const char *s)
+{
+	size_t len = strlen(s) + 1;
+	char *copy = memAlloc(tag, len);
+	if (copy)
+		memcpy(copy, s, len);
+	return copy;
+}
+
+void lineStorageReport();
+
+// printed after the console is restored, anything still live at this point is a leak or was never meant to be freed
+void memoryReport()
+{
+	if (!memory.report)
+		return;
+	printf("%-10s %14s %14s %12s %12s\n", "subsystem", "live bytes", "peak bytes", "allocs", "frees");
+	for (int i = 0; i < MEM_TAGS; i++)
+		printf("%-10s %14lld %14lld %12lld %12lld\n", memory_tag_names[i], (long long)memory.bytes[i], (long long)memory.peak[i], (long long)memory.calls[i], (long long)memory.frees[i]);
+	printf("%-10s %14lld %14lld\n", "total", (long long)memory.total, (long long)memory.total_peak);
+	lineStorageReport();
+}
+
 /*** buffer operations ***/
 struct StringBuilder
 {
@@ -57,7 +197,7 @@ struct StringBuilder
 
 void appendToBuffer(const char *add, int len)
 {
-	char *s = realloc(sb->chars, sb->len + len); // all the data from our string builder is now at s
+	char *s = memRealloc(MEM_SCREEN, sb->chars, sb->len + len); // all the data from our string builder is now at s
 
 	if (s == NULL)
 		return;
@@ -68,38 +208,266 @@ void appendToBuffer(const char *add, int len)
 
 void freeBuffer()
 {
-	free(sb->chars);
+	memFree(sb->chars);
+}
+
+/*** LINE STORAGE ***/
+// line text comes from size-classed slabs, each class twice the size of the one before, so a line that keeps
+// growing only moves when it crosses a power of two and freed blocks are reused by the next line of that size
+typedef struct Arena
+{
+	char *text;
+	size_t size;
+	int refs; // lines still pointing into text
+} Arena;
+
+struct
+{
+	// line text and its tab-expanded render get separate pages so each is counted under its own tag
+	char *free_lists[MEM_TAGS][SLAB_CLASSES];
+	char *pages[MEM_TAGS][SLAB_CLASSES]; // page each class is currently carving blocks from
+	int page_used[MEM_TAGS][SLAB_CLASSES];
+	Arena *arenas; // text of bulk loaded files, freed once no line points into it
+	int num_arenas;
+	long long page_bytes, slab_live, heap_live, arena_bytes;
+	long long allocs, grows, moves;
+} slabs = {.arenas = NULL, .num_arenas = 0, .page_bytes = 0, .slab_live = 0, .heap_live = 0, .arena_bytes = 0, .allocs = 0, .grows = 0, .moves = 0};
+
+int slabClass(int size)
+{
+	int class = 0;
+	while (class < SLAB_CLASSES && (SLAB_MIN_SIZE << class) < size)
+		class++;
+	return class;
+}
+
+// hands out at least size bytes, the real capacity goes to *cap
+char *textAlloc(enum MemoryTag tag, int size, int *cap)
+{
+	slabs.allocs++;
+	int class = slabClass(size);
+	if (class == SLAB_CLASSES)
+	{
+		// too big for a slab, still rounded up to a power of two so long lines grow geometrically
+		for (*cap = SLAB_MIN_SIZE << (SLAB_CLASSES - 1); *cap < size; *cap *= 2)
+			;
+		char *text = memAlloc(tag, *cap);
+		if (text == NULL)
+			die("Failed to allocate line");
+		slabs.heap_live += *cap;
+		return text;
+	}
+
+	*cap = SLAB_MIN_SIZE << class;
+	slabs.slab_live += *cap;
+	char *block = slabs.free_lists[tag][class];
+	if (block)
+	{
+		memcpy(&slabs.free_lists[tag][class], block, sizeof(char *)); // free blocks store the next one in their first bytes
+		return block;
+	}
+	if (!slabs.pages[tag][class] || slabs.page_used[tag][class] + *cap > SLAB_PAGE_SIZE)
+	{
+		if ((slabs.pages[tag][class] = memAlloc(tag, SLAB_PAGE_SIZE)) == NULL)
+			die("Failed to allocate line");
+		slabs.page_used[tag][class] = 0;
+		slabs.page_bytes += SLAB_PAGE_SIZE;
+	}
+	block = slabs.pages[tag][class] + slabs.page_used[tag][class];
+	slabs.page_used[tag][class] += *cap;
+	return block;
+}
+
+void textFree(enum MemoryTag tag, char *text, int cap)
+{
+	int class = slabClass(cap);
+	if (class == SLAB_CLASSES)
+	{
+		slabs.heap_live -= cap;
+		memFree(text);
+		return;
+	}
+	slabs.slab_live -= cap;
+	memcpy(text, &slabs.free_lists[tag][class], sizeof(char *));
+	slabs.free_lists[tag][class] = text;
+}
+
+char *arenaCreate(size_t size)
+{
+	char *text = memAlloc(MEM_LINES, size);
+	if (text == NULL || (slabs.arenas = memRealloc(MEM_LINES, slabs.arenas, sizeof(Arena) * (slabs.num_arenas + 1))) == NULL)
+		die("Failed to load file");
+	slabs.arenas[slabs.num_arenas++] = (Arena){text, size, 0};
+	slabs.arena_bytes += size;
+	return text;
+}
+
+void arenaRelease(char *text)
+{
+	for (int i = 0; i < slabs.num_arenas; i++)
+	{
+		Arena *arena = &slabs.arenas[i];
+		if (text < arena->text || text >= arena->text + arena->size)
+			continue;
+		if (--arena->refs <= 0)
+		{
+			slabs.arena_bytes -= arena->size;
+			memFree(arena->text);
+			slabs.arenas[i] = slabs.arenas[--slabs.num_arenas];
+		}
+		return;
+	}
 }
 
 /*** EDITOR CONFIGURATIONS AND SETUP + OPERATIONS ***/
 typedef struct Line
 {
 	int len, rlen;
-	char *chars, *rchars;
+	char *chars, *rchars; // rchars is chars itself when the line has no tabs to expand
+	int cap, rcap; // slab capacity of each, a cap of 0 means chars points into a load arena
 } Line;
 
-struct
+typedef struct Cursor
+{
+	int x, y;
+} Cursor;
+
+void indexLine(Line *line, int delta);
+
+typedef struct Document
 {
-	int cursor_x, cursor_y, render_x;
-	int rows, cols;
-	DWORD orig_in_mode, orig_out_mode;
 	Line *lines;
 	int num_lines;
-	int row_offset, col_offset;
 	char *filename;
+	char *path; // full path of filename, what another open of the same file is matched against
+	bool dirty;
+	bool can_undo; // only whole document replacements are undoable, the previous document is kept here
+	Line *undo_lines;
+	int undo_num_lines;
+	int last_x, last_y; // cursor when a view last switched away from it
+} Document;
+
+// a window onto a document - views of the same document share its lines and only keep their own cursors and scroll
+typedef struct View
+{
+	Document *doc;
+	int cursor_x, cursor_y, render_x;
+	int top, left, rows, cols; // screen area for the text, the view's bar sits on the row below it
+	int row_offset, col_offset;
+	int drawn_row_offset, drawn_col_offset; // offsets of the last frame, a view that scrolled is redrawn in full
+	Cursor *cursors; // extra cursors, the primary one is cursor_x/cursor_y
+	int num_cursors;
+	bool block; // rectangular selection between the anchor and the primary cursor
+	int block_x, block_y; // anchor - block_x is a render column since tabs make char columns ragged
+} View;
+
+// the screen is a tree of splits with a view in every leaf, node 0 is the root
+typedef struct Split
+{
+	int parent;
+	int children[2]; // -1 in leaves
+	bool vertical; // children sit side by side instead of stacked
+	View *view;
+	int top, left, rows, cols;
+} Split;
+
+struct
+{
+	int screen_rows, screen_cols;
+	DWORD orig_in_mode, orig_out_mode;
+	Document **documents; // every open buffer, whether or not a view shows it
+	int num_documents;
+	Split *splits;
+	int num_splits;
+	View *view; // focused view and its document
+	Document *doc;
 	char status[128];
 	time_t status_time;
-	bool dirty;
-} editor = {.cursor_x = 0, .render_x = 0, .cursor_y = 0, .lines = NULL, .num_lines = 0, .row_offset = 0, .col_offset = 0, .filename = NULL, .status[0] = '\0', .status_time = 0, .dirty = false};
+	bool partial_redraw; // only the redraw_lines of redraw_doc changed since the last frame
+	Document *redraw_doc;
+	int *redraw_lines; // ascending
+	int num_redraw_lines;
+} editor = {.documents = NULL, .num_documents = 0, .splits = NULL, .num_splits = 0, .view = NULL, .doc = NULL, .status[0] = '\0', .status_time = 0, .partial_redraw = false, .redraw_doc = NULL, .redraw_lines = NULL, .num_redraw_lines = 0};
 
-void cursorToRenderX(Line *line)
+int lineRenderX(Line *line, int x)
 {
-	for (int i = 0; i < editor.cursor_x; i++)
+	int render_x = 0;
+	for (int i = 0; i < x; i++)
 	{
 		if (line->chars[i] == '\t')
-			editor.render_x += TAB_LENGTH - 1 - editor.render_x % TAB_LENGTH;
-		editor.render_x++;
+			render_x += TAB_LENGTH - 1 - render_x % TAB_LENGTH;
+		render_x++;
+	}
+	return render_x;
+}
+
+// inverse of lineRenderX, columns past the end of the line clamp to its length
+int renderToCursorX(Line *line, int render_x)
+{
+	int rx = 0, x;
+	for (x = 0; x < line->len; x++)
+	{
+		if (line->chars[x] == '\t')
+			rx += TAB_LENGTH - 1 - rx % TAB_LENGTH;
+		if (++rx > render_x)
+			return x;
+	}
+	return x;
+}
+
+// makes room for size bytes of text, moving the line out of its slab class or load arena only when it has to
+void lineReserve(Line *line, int size)
+{
+	slabs.grows++;
+	if (size <= line->cap)
+		return;
+	slabs.moves++;
+	int cap;
+	char *chars = textAlloc(MEM_LINES, size, &cap);
+	memcpy(chars, line->chars, line->len + 1);
+	if (line->rchars == line->chars)
+		line->rchars = chars; // keep the alias valid until the caller re-renders
+	if (line->cap)
+		textFree(MEM_LINES, line->chars, line->cap);
+	else if (line->chars)
+		arenaRelease(line->chars);
+	line->chars = chars;
+	line->cap = cap;
+}
+
+void lineFree(Line *line)
+{
+	if (line->rchars != line->chars)
+		textFree(MEM_RENDER, line->rchars, line->rcap);
+	if (line->cap)
+		textFree(MEM_LINES, line->chars, line->cap);
+	else
+		arenaRelease(line->chars);
+	line->chars = line->rchars = NULL;
+}
+
+// fragmentation of line storage, comparing the bytes text actually uses with what the slabs hold for it
+void lineStorageReport()
+{
+	long long used = 0;
+	for (int d = 0; d < editor.num_documents * 2; d++)
+	{
+		Document *doc = editor.documents[d / 2];
+		Line *lines = d % 2 ? doc->undo_lines : doc->lines;
+		int count = d % 2 ? (doc->can_undo ? doc->undo_num_lines : 0) : doc->num_lines;
+		for (int i = 0; i < count; i++)
+		{
+			Line *line = &lines[i];
+			if (line->cap)
+				used += line->len + 1;
+			if (line->rchars != line->chars)
+				used += line->rlen + 1;
+		}
 	}
+	long long reserved = slabs.slab_live + slabs.heap_live;
+	printf("\nline storage: %lld allocations, %lld of %lld reserves had to move the line\n", slabs.allocs, slabs.moves, slabs.grows);
+	printf("  slab pages %lld bytes, %lld handed out (%.1f%% unused or on free lists)\n", slabs.page_bytes, slabs.slab_live, slabs.page_bytes ? 100.0 * (slabs.page_bytes - slabs.slab_live) / slabs.page_bytes : 0.0);
+	printf("  text %lld bytes in %lld reserved (%.1f%% growth slack), long lines %lld bytes, load arenas %lld bytes\n", used, reserved, reserved ? 100.0 * (reserved - used) / reserved : 0.0, slabs.heap_live, slabs.arena_bytes);
 }
 
 void updateLine(Line *line)
@@ -109,9 +477,23 @@ void updateLine(Line *line)
 		if (line->chars[i] == '\t')
 			tabs++;
 
-	free(line->rchars);
+	if (!tabs)
+	{
+		if (line->rchars && line->rchars != line->chars)
+			textFree(MEM_RENDER, line->rchars, line->rcap);
+		line->rchars = line->chars;
+		line->rlen = line->len;
+		return;
+	}
 	// subtract 1 from tab length since the escape character is already accounted for
-	line->rchars = malloc(line->len + tabs * (TAB_LENGTH - 1) + 1);
+	int size = line->len + tabs * (TAB_LENGTH - 1) + 1;
+	if (line->rchars == line->chars || !line->rchars)
+		line->rchars = textAlloc(MEM_RENDER, size, &line->rcap);
+	else if (size > line->rcap)
+	{
+		textFree(MEM_RENDER, line->rchars, line->rcap);
+		line->rchars = textAlloc(MEM_RENDER, size, &line->rcap);
+	}
 	int index = 0;
 	for (int i = 0; i < line->len; i++)
 	{
@@ -131,80 +513,198 @@ void updateLine(Line *line)
 
 void insertLine(int index, char *str, size_t len)
 {
-	if (index < 0 || index > editor.num_lines)
+	if (index < 0 || index > editor.doc->num_lines)
 		return;
 	// allocate space for an extra line
-	if((editor.lines = realloc(editor.lines, sizeof(Line) * (editor.num_lines + 1))) == NULL)
+	if((editor.doc->lines = memRealloc(MEM_LINES, editor.doc->lines, sizeof(Line) * (editor.doc->num_lines + 1))) == NULL)
 		die("Failed to insert line");
 
-	memmove(&editor.lines[index + 1], &editor.lines[index], sizeof(Line) * (editor.num_lines - index));
-	editor.lines[index] = (Line){len, 0, malloc(len + 1), NULL};
-	memcpy(editor.lines[index].chars, str, len);
-	editor.lines[index].chars[len] = '\0';
+	memmove(&editor.doc->lines[index + 1], &editor.doc->lines[index], sizeof(Line) * (editor.doc->num_lines - index));
+	editor.doc->lines[index] = (Line){len, 0, NULL, NULL, 0, 0};
+	editor.doc->lines[index].chars = textAlloc(MEM_LINES, len + 1, &editor.doc->lines[index].cap);
+	memcpy(editor.doc->lines[index].chars, str, len);
+	editor.doc->lines[index].chars[len] = '\0';
 
-	updateLine(&editor.lines[index]);
-	editor.num_lines++;
+	updateLine(&editor.doc->lines[index]);
+	indexLine(&editor.doc->lines[index], 1);
+	editor.doc->num_lines++;
 }
 
 void insertNewline()
 {
-	if (editor.cursor_x == 0)
-		insertLine(editor.cursor_y, "", 0);
+	if (editor.view->cursor_x == 0)
+		insertLine(editor.view->cursor_y, "", 0);
 	else
 	{
-		Line *line = &editor.lines[editor.cursor_y];
-		insertLine(editor.cursor_y + 1, &line->chars[editor.cursor_x], line->len - editor.cursor_x);
-		line = &editor.lines[editor.cursor_y];
-		line->len = editor.cursor_x;
+		Line *line = &editor.doc->lines[editor.view->cursor_y];
+		indexLine(line, -1);
+		insertLine(editor.view->cursor_y + 1, &line->chars[editor.view->cursor_x], line->len - editor.view->cursor_x);
+		line = &editor.doc->lines[editor.view->cursor_y];
+		line->len = editor.view->cursor_x;
 		line->chars[line->len] = '\0';
 		updateLine(line);
+		indexLine(line, 1);
+	}
+
+	editor.view->cursor_x = 0;
+	editor.view->cursor_y++;
+	editor.doc->dirty = true;
+}
+
+void blockColumns(View *view, int *left, int *right)
+{
+	int cursor_rx = view->cursor_y < view->doc->num_lines ? lineRenderX(&view->doc->lines[view->cursor_y], view->cursor_x) : 0;
+	*left = view->block_x < cursor_rx ? view->block_x : cursor_rx;
+	*right = view->block_x < cursor_rx ? cursor_rx : view->block_x;
+}
+
+// draws the visible part of a line, showing the block selection and extra cursors in reverse video, returns the columns used
+int drawLine(View *view, int y)
+{
+	Line *line = &view->doc->lines[y];
+	int len = line->rlen - view->col_offset;
+	clamp(&len, 0, view->cols);
+	bool in_block = view->block && y >= (view->block_y < view->cursor_y ? view->block_y : view->cursor_y) && y <= (view->block_y < view->cursor_y ? view->cursor_y : view->block_y);
+	if (!in_block && !view->num_cursors)
+	{
+		appendToBuffer(&line->rchars[view->col_offset], len);
+		return len;
+	}
+
+	bool marked[view->cols];
+	memset(marked, 0, sizeof(marked));
+	int width = len;
+	if (in_block)
+	{
+		int left, right;
+		blockColumns(view, &left, &right);
+		if (left == right)
+			right++; // zero width block still shows where text will go
+		for (int rx = left; rx < right; rx++)
+			if (rx - view->col_offset >= 0 && rx - view->col_offset < view->cols)
+				marked[rx - view->col_offset] = true;
+		if (right - view->col_offset > width)
+			width = right - view->col_offset;
+	}
+	for (int i = 0; i < view->num_cursors; i++)
+	{
+		if (view->cursors[i].y != y)
+			continue;
+		int col = lineRenderX(line, view->cursors[i].x) - view->col_offset;
+		if (col < 0 || col >= view->cols)
+			continue;
+		marked[col] = true;
+		if (col + 1 > width)
+			width = col + 1;
+	}
+	clamp(&width, 0, view->cols);
+
+	for (int i = 0, j; i < width; i = j)
+	{
+		for (j = i; j < width && marked[j] == marked[i]; j++)
+			;
+		if (marked[i])
+			appendToBuffer("\x1b[7m", 4);
+		int text = (j < len ? j : len) - i;
+		if (text > 0)
+			appendToBuffer(&line->rchars[view->col_offset + i], text);
+		for (int k = text > 0 ? text : 0; k < j - i; k++)
+			appendToBuffer(" ", 1); // selection past the end of the line
+		if (marked[i])
+			appendToBuffer("\x1b[m", 3);
 	}
+	return width;
+}
+
+void moveTo(int row, int col)
+{
+	char buf[32];
+	// terminal is 1-indexed
+	snprintf(buf, sizeof(buf), "\x1b[%d;%dH", row + 1, col + 1);
+	appendToBuffer(buf, strlen(buf));
+}
 
-	editor.cursor_x = 0;
-	editor.cursor_y++;
-	editor.dirty = true;
+// views that don't reach the right edge of the screen pad with spaces so they can't clear their neighbours
+void clearRest(View *view, int used)
+{
+	if (view->left + view->cols >= editor.screen_cols)
+	{
+		appendToBuffer("\x1b[K", 3);
+		return;
+	}
+	for (; used < view->cols; used++)
+		appendToBuffer(" ", 1);
 }
 
-void writeLines()
+void writeLines(View *view)
 {
-	for (int i = 0; i < editor.rows; i++)
+	bool scrolled = view->row_offset != view->drawn_row_offset || view->col_offset != view->drawn_col_offset;
+	int next = 0;
+	for (int i = 0; i < view->rows; i++)
 	{
-		int currentLine = i + editor.row_offset;
-		if (currentLine >= editor.num_lines)
+		int currentLine = i + view->row_offset;
+		// batched edits only touch a known set of lines, leave the rest of the screen alone
+		if (editor.partial_redraw && !scrolled)
+		{
+			while (next < editor.num_redraw_lines && editor.redraw_lines[next] < currentLine)
+				next++;
+			if (view->doc != editor.redraw_doc || next == editor.num_redraw_lines || editor.redraw_lines[next] != currentLine)
+				continue;
+		}
+		moveTo(view->top + i, view->left);
+		int used;
+		if (currentLine >= view->doc->num_lines)
 		{
 			appendToBuffer("~", 1); // typical editor filler
+			used = 1;
 		}
 		else
 		{
-			int len = editor.lines[currentLine].rlen - editor.col_offset;
-			clamp(&len, 0, editor.cols);
-			appendToBuffer(&editor.lines[currentLine].rchars[editor.col_offset], len);
+			used = drawLine(view, currentLine);
 		}
-		appendToBuffer("\x1b[K", 3);
-		appendToBuffer("\r\n", 2);
+		clearRest(view, used);
 	}
+	view->drawn_row_offset = view->row_offset;
+	view->drawn_col_offset = view->col_offset;
 }
 
-void editorBar()
+void editorBar(View *view)
 {
-	appendToBuffer("\x1b[7m", 4);
-	char buffer[256], position[32]; // need buffer to be large since it will contain all the spaces as well
+	moveTo(view->top + view->rows, view->left);
+	appendToBuffer(view == editor.view ? "\x1b[1;7m" : "\x1b[7m", view == editor.view ? 6 : 4); // focused view's bar is bold
+	char buffer[256], position[64], name[256]; // need buffer to be large since it will contain all the spaces as well
 	const char* untitled = "[Untitled]";
-	char *name = editor.filename ? strdup(editor.filename) : strdup(untitled);
-	if (editor.dirty)
-		strcat(name, "*");
-	int len = snprintf(position, sizeof(position), "Line: %d/%d, Col %d/%d", editor.cursor_y + 1, editor.num_lines, editor.cursor_x, editor.cursor_y < editor.num_lines ? editor.lines[editor.cursor_y].len : 0);
-	len = snprintf(buffer, sizeof(buffer), "%-*.20s", editor.cols - len, name);
-	appendToBuffer(buffer, len);
-	appendToBuffer(position, strlen(position));
-	appendToBuffer("\x1b[m\r\n", 5);
+	snprintf(name, sizeof(name), "%.20s%s", view->doc->filename ? view->doc->filename : untitled, view->doc->dirty ? "*" : "");
+	if (memory.overlay)
+	{
+		// live kilobytes of every subsystem that currently holds memory, after the name so split views stay told apart
+		int used = strlen(name);
+		used += snprintf(&name[used], sizeof(name) - used, " | Heap %lldK peak %lldK |", (long long)memory.total / 1024, (long long)memory.total_peak / 1024);
+		for (int i = 0; i < MEM_TAGS && used < (int)sizeof(name); i++)
+			if (memory.bytes[i])
+				used += snprintf(&name[used], sizeof(name) - used, " %s %lldK/%lld", memory_tag_names[i], (long long)memory.bytes[i] / 1024, (long long)memory.calls[i]);
+	}
+	char mode[32] = "";
+	if (view->block)
+		snprintf(mode, sizeof(mode), "[Block] ");
+	else if (view->num_cursors)
+		snprintf(mode, sizeof(mode), "[%d Cursors] ", view->num_cursors + 1);
+	snprintf(position, sizeof(position), "%sLine: %d/%d, Col %d/%d", mode, view->cursor_y + 1, view->doc->num_lines, view->cursor_x, view->cursor_y < view->doc->num_lines ? view->doc->lines[view->cursor_y].len : 0);
+	int len = clamp(&(int){strlen(position)}, 0, view->cols);
+	int width = view->cols - len;
+	clamp(&width, 0, sizeof(buffer) - 1);
+	snprintf(buffer, sizeof(buffer), "%-*.*s", width, width, name);
+	appendToBuffer(buffer, strlen(buffer));
+	appendToBuffer(position, len);
+	appendToBuffer("\x1b[m", 3);
 }
 
 // only shows for fives seconds or until user inputs a key after five seconds
 void statusBar()
 {
+	moveTo(editor.screen_rows - 1, 0);
 	appendToBuffer("\x1b[K", 3);
-	int len = clamp(&(int){strlen(editor.status)}, 0, editor.cols);
+	int len = clamp(&(int){strlen(editor.status)}, 0, editor.screen_cols);
 	if (len && time(NULL) - editor.status_time < 5)
 		appendToBuffer(editor.status, len);
 }
@@ -222,7 +722,7 @@ void setStatusMessage(const char *fmt, ...)
 char *prompt(char *prompt)
 {
 	int size = 128;
-	char *str = malloc(size);
+	char *str = memAlloc(MEM_PROMPT, size);
 	int len = 0;
 	str[0] = '\0';
 	while (1)
@@ -238,7 +738,7 @@ char *prompt(char *prompt)
 		else if (c == ESCAPE_KEY)
 		{
 			setStatusMessage("");
-			free(str);
+			memFree(str);
 			return NULL;
 		}
 		else if (c == ENTER_KEY)
@@ -254,7 +754,7 @@ char *prompt(char *prompt)
 			if (len == size - 1)
 			{
 				size *= 2;
-				str = realloc(str, size);
+				str = memRealloc(MEM_PROMPT, str, size);
 			}
 			str[len++] = c;
 			str[len] = '\0';
@@ -262,314 +762,2059 @@ char *prompt(char *prompt)
 	}
 }
 
-/*** EDITOR INPUT ***/
-
-// need positions for search and replace functionality later on
-void lineInsert(Line *line, int index, char c)
+/*** EDITOR INPUT ***/
+
+// need positions for search and replace functionality later on
+void lineInsertString(Line *line, int index, const char *str, int len)
+{
+	if (index < 0 || index > line->len)
+		index = line->len;
+
+	indexLine(line, -1);
+	lineReserve(line, line->len + len + 1);
+	memmove(&line->chars[index + len], &line->chars[index], line->len - index + 1); // + 1 to move null terminator
+
+	line->len += len;
+	memcpy(&line->chars[index], str, len);
+	updateLine(line);
+	indexLine(line, 1);
+	editor.doc->dirty = true;
+}
+
+void lineInsert(Line *line, int index, char c)
+{
+	lineInsertString(line, index, &c, 1);
+}
+
+void insert(char c)
+{
+	if (editor.view->cursor_y == editor.doc->num_lines)
+		insertLine(editor.doc->num_lines, "", 0);
+	lineInsert(&editor.doc->lines[editor.view->cursor_y], editor.view->cursor_x++, c);
+}
+
+void lineDelete(Line *line, int index)
+{
+	if (index < 0 || index > line->len)
+		return;
+	indexLine(line, -1);
+	memmove(&line->chars[index], &line->chars[index + 1], line->len-- - index);
+	updateLine(line);
+	indexLine(line, 1);
+	editor.doc->dirty = true;
+}
+
+void deleteRow(int index)
+{
+	if (index < 0 || index > editor.doc->num_lines)
+		return;
+	indexLine(&editor.doc->lines[index], -1);
+	lineFree(&editor.doc->lines[index]);
+
+	memmove(&editor.doc->lines[index], &editor.doc->lines[index + 1], sizeof(Line) * (--editor.doc->num_lines - index));
+	editor.doc->dirty = true;
+}
+
+void appendToLine(Line *line, char *str, int len)
+{
+	indexLine(line, -1);
+	lineReserve(line, line->len + len + 1);
+	memcpy(&line->chars[line->len], str, len);
+	line->len += len;
+	line->chars[line->len] = '\0';
+	updateLine(line);
+	indexLine(line, 1);
+	editor.doc->dirty = true; // TODO come back later to delete if unnecessary
+}
+
+void delete()
+{
+	if (!editor.view->cursor_x && !editor.view->cursor_y)
+		return;
+	if (editor.view->cursor_x > 0)
+		lineDelete(&editor.doc->lines[editor.view->cursor_y], --editor.view->cursor_x);
+	else
+	{
+		editor.view->cursor_y--;
+		editor.view->cursor_x = editor.doc->lines[editor.view->cursor_y].len;
+		appendToLine(&editor.doc->lines[editor.view->cursor_y], editor.doc->lines[editor.view->cursor_y + 1].chars, editor.doc->lines[editor.view->cursor_y + 1].len);
+		deleteRow(editor.view->cursor_y + 1);
+	}
+}
+
+/*** MULTI-CURSOR AND BLOCK EDITING ***/
+// a cursor's pending change - characters in [start, end) are removed, then c is inserted at start when inserting
+typedef struct Edit
+{
+	int y, start, end;
+	int cursor; // index of the cursor that follows this edit
+} Edit;
+
+bool multiEditing()
+{
+	return editor.view->block || editor.view->num_cursors;
+}
+
+void clearCursors()
+{
+	memFree(editor.view->cursors);
+	editor.view->cursors = NULL;
+	editor.view->num_cursors = 0;
+	editor.view->block = false;
+}
+
+void toggleBlock()
+{
+	bool block = !editor.view->block;
+	clearCursors(); // block edits build their own cursors, extra ones would be left unshifted
+	editor.view->block = block;
+	editor.view->block_y = editor.view->cursor_y;
+	editor.view->block_x = editor.view->cursor_y < editor.doc->num_lines ? lineRenderX(&editor.doc->lines[editor.view->cursor_y], editor.view->cursor_x) : 0;
+}
+
+int compareCursors(const void *a, const void *b)
+{
+	const Cursor *ca = a, *cb = b;
+	return ca->y != cb->y ? ca->y - cb->y : ca->x - cb->x;
+}
+
+// sorts the extra cursors and drops any that landed on the same spot as another one
+void normalizeCursors(View *view)
+{
+	if (!view->num_cursors)
+		return;
+	qsort(view->cursors, view->num_cursors, sizeof(Cursor), compareCursors);
+	int n = 0;
+	for (int i = 0; i < view->num_cursors; i++)
+	{
+		Cursor c = view->cursors[i];
+		if ((c.x == view->cursor_x && c.y == view->cursor_y) || (n && c.x == view->cursors[n - 1].x && c.y == view->cursors[n - 1].y))
+			continue;
+		view->cursors[n++] = c;
+	}
+	view->num_cursors = n;
+}
+
+// drops a cursor where the primary one is, so it can move on to the next spot
+void addCursor()
+{
+	if (editor.view->block || editor.view->cursor_y >= editor.doc->num_lines)
+		return;
+	if ((editor.view->cursors = memRealloc(MEM_CURSORS, editor.view->cursors, sizeof(Cursor) * (editor.view->num_cursors + 1))) == NULL)
+		die("Failed to add cursor");
+	editor.view->cursors[editor.view->num_cursors++] = (Cursor){editor.view->cursor_x, editor.view->cursor_y};
+	moveCursor(ARROW_DOWN);
+	normalizeCursors(editor.view);
+}
+
+int compareEdits(const void *a, const void *b)
+{
+	const Edit *ea = a, *eb = b;
+	if (ea->y != eb->y)
+		return ea->y - eb->y;
+	if (ea->start != eb->start)
+		return eb->start - ea->start; // right to left within a line so offsets of the remaining edits stay valid
+	return eb->end - ea->end; // an empty edit at the same spot sits left of the one that deletes
+}
+
+// every line is resized, rewritten and re-rendered once no matter how many cursors sit on it,
+// every cursor owns an edit (maybe empty) so each one is shifted by the edits to its left
+void applyEdits(Edit *edits, int n, Cursor *cursors, bool inserting, char c)
+{
+	qsort(edits, n, sizeof(Edit), compareEdits);
+	int added = inserting ? 1 : 0;
+	bool dirty = false;
+	editor.num_redraw_lines = 0;
+	if ((editor.redraw_lines = memRealloc(MEM_SCREEN, editor.redraw_lines, sizeof(int) * (n ? n : 1))) == NULL)
+		die("Out of memory");
+	for (int i = 0, j; i < n; i = j)
+	{
+		Line *line = &editor.doc->lines[edits[i].y];
+		bool changed = inserting;
+		for (j = i; j < n && edits[j].y == edits[i].y; j++)
+			changed |= edits[j].start != edits[j].end;
+
+		// walk back left to right to shift each cursor by the edits before it
+		int shift = 0;
+		for (int k = j - 1; k >= i; k--)
+		{
+			cursors[edits[k].cursor].x = edits[k].start + shift + added;
+			shift += added - (edits[k].end - edits[k].start);
+		}
+		// a block's highlight moves on every row when it collapses, even rows the keystroke left alone
+		if (changed || editor.view->block)
+			editor.redraw_lines[editor.num_redraw_lines++] = edits[i].y;
+		if (!changed)
+			continue;
+		dirty = true;
+		indexLine(line, -1);
+		if (inserting)
+			lineReserve(line, line->len + (j - i) + 1);
+
+		for (int k = i; k < j; k++)
+		{
+			Edit *e = &edits[k];
+			memmove(&line->chars[e->start + added], &line->chars[e->end], line->len - e->end + 1); // + 1 to move null terminator
+			if (inserting)
+				line->chars[e->start] = c;
+			line->len += added - (e->end - e->start);
+		}
+		updateLine(line);
+		indexLine(line, 1);
+	}
+
+	if (dirty)
+		editor.doc->dirty = true;
+	if (editor.num_redraw_lines)
+	{
+		editor.partial_redraw = true;
+		editor.redraw_doc = editor.doc;
+	}
+}
+
+// builds one edit per cursor (or per block row) for a keystroke and applies them as a single batch
+void batchEdit(int key)
+{
+	bool inserting = key != BACKSPACE && key != DELETE_KEY;
+	Cursor *cursors;
+	int n = 0, top = 0, left = 0, right = 0;
+
+	if (editor.view->block)
+	{
+		top = editor.view->block_y < editor.view->cursor_y ? editor.view->block_y : editor.view->cursor_y;
+		int bottom = editor.view->block_y < editor.view->cursor_y ? editor.view->cursor_y : editor.view->block_y;
+		clamp(&bottom, top, editor.doc->num_lines - 1);
+		blockColumns(editor.view, &left, &right);
+		n = bottom - top + 1;
+		if (n <= 0)
+			return;
+		cursors = memAlloc(MEM_CURSORS, sizeof(Cursor) * n);
+		for (int i = 0; i < n; i++)
+			cursors[i] = (Cursor){renderToCursorX(&editor.doc->lines[top + i], left), top + i};
+	}
+	else
+	{
+		cursors = memAlloc(MEM_CURSORS, sizeof(Cursor) * (editor.view->num_cursors + 1));
+		if (editor.view->cursor_y < editor.doc->num_lines)
+			cursors[n++] = (Cursor){editor.view->cursor_x, editor.view->cursor_y};
+		memcpy(&cursors[n], editor.view->cursors, sizeof(Cursor) * editor.view->num_cursors);
+		n += editor.view->num_cursors;
+	}
+
+	Edit *edits = memAlloc(MEM_CURSORS, sizeof(Edit) * n);
+	int num_edits = 0;
+	for (int i = 0; i < n; i++)
+	{
+		Line *line = &editor.doc->lines[cursors[i].y];
+		int start = cursors[i].x, end = cursors[i].x;
+		if (editor.view->block && right > left)
+			end = renderToCursorX(line, right); // typing over a selection replaces it
+		else if (key == BACKSPACE && start > 0)
+			start--;
+		else if (key == DELETE_KEY && end < line->len)
+			end++;
+		edits[num_edits++] = (Edit){cursors[i].y, start, end, i};
+	}
+	applyEdits(edits, num_edits, cursors, inserting, key);
+
+	if (editor.view->block)
+	{
+		// selection collapses to a column so the next keystroke keeps typing on every row
+		if (editor.view->cursor_y >= top && editor.view->cursor_y < top + n)
+			editor.view->cursor_x = cursors[editor.view->cursor_y - top].x;
+		editor.view->block_x = editor.view->cursor_y < editor.doc->num_lines ? lineRenderX(&editor.doc->lines[editor.view->cursor_y], editor.view->cursor_x) : 0;
+	}
+	else
+	{
+		int i = 0;
+		if (editor.view->cursor_y < editor.doc->num_lines)
+			editor.view->cursor_x = cursors[i++].x;
+		memcpy(editor.view->cursors, &cursors[i], sizeof(Cursor) * editor.view->num_cursors);
+		normalizeCursors(editor.view);
+	}
+	memFree(edits);
+	memFree(cursors);
+}
+
+/*** WORD INDEX ***/
+// every identifier in the buffer lives in a trie, each node caching the most frequent word below it,
+// so a completion is one walk down the prefix plus a look at the children no matter how big the buffer is
+typedef struct TrieNode
+{
+	int parent;
+	char c;
+	int count; // occurrences of the word ending at this node
+	int best; // node of the most frequent word in this subtree, -1 if there is none
+	int *children; // sorted by character
+	int num_children;
+} TrieNode;
+
+struct
+{
+	TrieNode *nodes;
+	int num_nodes, cap_nodes;
+	int distinct, tokens;
+	size_t child_bytes;
+} words = {.nodes = NULL, .num_nodes = 0, .cap_nodes = 0, .distinct = 0, .tokens = 0, .child_bytes = 0};
+
+bool isWordChar(char c)
+{
+	return isalnum((unsigned char)c) || c == '_';
+}
+
+int trieNode(int parent, char c)
+{
+	if (words.num_nodes == words.cap_nodes)
+	{
+		words.cap_nodes = words.cap_nodes ? words.cap_nodes * 2 : 1024;
+		if ((words.nodes = memRealloc(MEM_INDEX, words.nodes, sizeof(TrieNode) * words.cap_nodes)) == NULL)
+			die("Failed to grow word index");
+	}
+	words.nodes[words.num_nodes] = (TrieNode){parent, c, 0, -1, NULL, 0};
+	return words.num_nodes++;
+}
+
+// binary search for a child, returns the insertion point negated and minus one when it's missing
+int trieChild(int node, char c)
+{
+	TrieNode *n = &words.nodes[node];
+	int lo = 0, hi = n->num_children;
+	while (lo < hi)
+	{
+		int mid = (lo + hi) / 2;
+		char mc = words.nodes[n->children[mid]].c;
+		if (mc == c)
+			return n->children[mid];
+		if ((unsigned char)mc < (unsigned char)c)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return -lo - 1;
+}
+
+int trieBestOf(int a, int b)
+{
+	if (a < 0 || (b >= 0 && words.nodes[b].count > words.nodes[a].count))
+		return b;
+	return a;
+}
+
+void trieRefreshBest(int node)
+{
+	TrieNode *n = &words.nodes[node];
+	n->best = n->count > 0 ? node : -1;
+	for (int i = 0; i < n->num_children; i++)
+		n->best = trieBestOf(n->best, words.nodes[n->children[i]].best);
+}
+
+void wordIndexAdd(const char *word, int len, int delta)
+{
+	if (!words.num_nodes)
+		trieNode(-1, '\0');
+	int node = 0;
+	for (int i = 0; i < len; i++)
+	{
+		int child = trieChild(node, word[i]);
+		if (child < 0)
+		{
+			if (delta < 0)
+				return;
+			int at = -child - 1;
+			child = trieNode(node, word[i]);
+			TrieNode *n = &words.nodes[node];
+			if ((n->children = memRealloc(MEM_INDEX, n->children, sizeof(int) * (n->num_children + 1))) == NULL)
+				die("Failed to grow word index");
+			memmove(&n->children[at + 1], &n->children[at], sizeof(int) * (n->num_children - at));
+			n->children[at] = child;
+			n->num_children++;
+			words.child_bytes += sizeof(int);
+		}
+		node = child;
+	}
+
+	TrieNode *n = &words.nodes[node];
+	if (n->count + delta < 0)
+		return;
+	if (!n->count && delta > 0)
+		words.distinct++;
+	else if (n->count && n->count + delta == 0)
+		words.distinct--;
+	n->count += delta;
+	words.tokens += delta;
+
+	// ancestors only need their cached best refreshed when this word could have overtaken it or was it
+	for (int word_node = node; node >= 0; node = words.nodes[node].parent)
+	{
+		if (delta > 0)
+			words.nodes[node].best = trieBestOf(words.nodes[node].best, word_node);
+		else if (words.nodes[node].best == word_node)
+			trieRefreshBest(node);
+	}
+}
+
+// re-tokenizes a single line, called with -1 before a line changes and 1 after
+void indexLine(Line *line, int delta)
+{
+	for (int i = 0; i < line->len;)
+	{
+		if (!isWordChar(line->chars[i]))
+		{
+			i++;
+			continue;
+		}
+		int start = i;
+		while (i < line->len && isWordChar(line->chars[i]))
+			i++;
+		if (!isdigit((unsigned char)line->chars[start]))
+			wordIndexAdd(&line->chars[start], i - start, delta);
+	}
+}
+
+size_t wordIndexBytes()
+{
+	return sizeof(TrieNode) * words.cap_nodes + words.child_bytes;
+}
+
+// completes the word before the cursor with the most frequent longer word sharing its prefix
+void complete()
+{
+	if (editor.view->cursor_y >= editor.doc->num_lines)
+		return;
+	Line *line = &editor.doc->lines[editor.view->cursor_y];
+	int start = editor.view->cursor_x;
+	while (start > 0 && isWordChar(line->chars[start - 1]))
+		start--;
+	if (start == editor.view->cursor_x)
+	{
+		setStatusMessage("Nothing to complete");
+		return;
+	}
+
+	int node = words.num_nodes ? 0 : -1;
+	for (int i = start; i < editor.view->cursor_x && node >= 0; i++)
+		node = trieChild(node, line->chars[i]);
+	int best = -1;
+	for (int i = 0; node >= 0 && i < words.nodes[node].num_children; i++)
+		best = trieBestOf(best, words.nodes[words.nodes[node].children[i]].best);
+	if (best < 0)
+	{
+		setStatusMessage("No completions - index: %d words, %d tokens, %d KB", words.distinct, words.tokens, (int)(wordIndexBytes() / 1024));
+		return;
+	}
+
+	char suffix[256];
+	int len = 0;
+	for (int n = best; n != node; n = words.nodes[n].parent)
+		len++;
+	if (len >= (int)sizeof(suffix))
+		return;
+	int count = words.nodes[best].count;
+	for (int n = best, i = len - 1; n != node; n = words.nodes[n].parent, i--)
+		suffix[i] = words.nodes[n].c;
+	clearCursors(); // the suffix goes in at the primary cursor only, like a line split
+	lineInsertString(line, editor.view->cursor_x, suffix, len);
+	editor.view->cursor_x += len;
+	setStatusMessage("Completed (%d uses) - index: %d words, %d tokens, %d KB", count, words.distinct, words.tokens, (int)(wordIndexBytes() / 1024));
+}
+
+// BASIC EDITOR FUNCTIONS
+char *ErrorExit()
+{
+	DWORD err = GetLastError();
+	LPVOID msg;
+
+	FormatMessageA(
+		FORMAT_MESSAGE_ALLOCATE_BUFFER |
+			FORMAT_MESSAGE_FROM_SYSTEM |
+			FORMAT_MESSAGE_IGNORE_INSERTS,
+		NULL,
+		err,
+		MAKELANGID(LANG_NEUTRAL, SUBLANG_DEFAULT),
+		(LPSTR)&msg,
+		0,
+		NULL);
+	char *buffer;
+	sprintf(buffer, "GetLastError() - %lu: %s\n", err, (char *)msg);
+	LocalFree(msg);
+	return buffer;
+}
+
+void die(const char *s, ...)
+{
+	va_list args;
+	va_start(args, s);
+	char message[128];
+	vsprintf(message, s, args); // error code from console
+	va_end(args);
+	resetScreen();
+
+	HANDLE stdIn = GetStdHandle(STD_INPUT_HANDLE);
+	HANDLE stdOut = GetStdHandle(STD_OUTPUT_HANDLE);
+
+	WriteConsoleA(stdOut, "\x1b[?1049l", 8, NULL, NULL);
+	if (!SetConsoleMode(stdIn, editor.orig_in_mode) || !SetConsoleMode(stdOut, editor.orig_out_mode))
+		printf("%ld - ", GetLastError());
+	strcat(message, "\n");
+	perror(message);
+	printf(ErrorExit());
+	exit(1);
+}
+
+void getWindowSize()
+{
+	CONSOLE_SCREEN_BUFFER_INFO console_info;
+	if (!GetConsoleScreenBufferInfo(GetStdHandle(STD_OUTPUT_HANDLE), &console_info))
+		die("Error on getting window size");
+
+	editor.screen_cols = console_info.srWindow.Right - console_info.srWindow.Left + 1;
+	editor.screen_rows = console_info.srWindow.Bottom - console_info.srWindow.Top + 1; // y increases as we go down so bottom minus top
+	layoutViews();
+}
+
+void disableRawMode()
+{
+	HANDLE stdIn = GetStdHandle(STD_INPUT_HANDLE);
+	HANDLE stdOut = GetStdHandle(STD_OUTPUT_HANDLE);
+
+	WriteConsoleA(stdOut, "\x1b[?1049l", 8, NULL, NULL);
+	if (!SetConsoleMode(stdIn, editor.orig_in_mode) || !SetConsoleMode(stdOut, editor.orig_out_mode))
+		die("DisableRawMode(): Error on setting console mode.");
+}
+
+void enableRawMode()
+{
+	// tcgetattr
+	HANDLE stdIn = GetStdHandle(STD_INPUT_HANDLE);
+	HANDLE stdOut = GetStdHandle(STD_OUTPUT_HANDLE);
+	if (!GetConsoleMode(stdIn, &editor.orig_in_mode) || !GetConsoleMode(stdOut, &editor.orig_out_mode))
+		die("EnableRawMode(): Error on getting console mode.");
+	atexit(disableRawMode);
+
+	DWORD rawIn = editor.orig_in_mode;
+	DWORD rawOut = editor.orig_out_mode;
+	// line input
+	rawIn &= ~(ENABLE_ECHO_INPUT | ENABLE_LINE_INPUT | ENABLE_PROCESSED_INPUT);
+	// input processing
+	rawIn |= ENABLE_EXTENDED_FLAGS;
+	rawIn &= ~ENABLE_QUICK_EDIT_MODE;
+	// output processing
+	rawOut |= ENABLE_PROCESSED_OUTPUT | ENABLE_VIRTUAL_TERMINAL_PROCESSING; // ViRTUAL_TERMINAL_PROCESSING allows ANSI escape characters
+
+	if (!SetConsoleMode(stdIn, rawIn) || !SetConsoleMode(stdOut, rawOut))
+		die("EnableRawMode(): Error on setting console mode.");
+}
+
+void init()
+{
+	HANDLE stdOut = GetStdHandle(STD_OUTPUT_HANDLE);
+	WriteConsoleA(stdOut, "\x1b[?1049h", 8, NULL, NULL);
+	resetScreen();
+	initViews();
+	getWindowSize();
+}
+
+/*** FILE I/O ***/
+// windows paths are case insensitive and f.txt, ./f.txt and C:\dir\f.txt can all name the same file
+char *fullPath(const char *filename)
+{
+	char path[MAX_PATH];
+	DWORD len = GetFullPathNameA(filename, sizeof(path), path, NULL);
+	return memStrdup(MEM_FILE, len && len < sizeof(path) ? path : filename);
+}
+
+// for streams that can't seek, such as pipes, there's no size up front so the text is read in chunks
+char *readStream(FILE *file, long long *size)
+{
+	char *buf = NULL;
+	size_t len = 0, cap = 0;
+	for (;;)
+	{
+		if (len == cap && (buf = memRealloc(MEM_FILE, buf, cap = cap ? cap * 2 : 65536)) == NULL)
+			die("Failed to load file");
+		size_t got = fread(&buf[len], 1, cap - len, file);
+		if (!got)
+			break;
+		len += got;
+	}
+	if (ferror(file))
+	{
+		memFree(buf);
+		return NULL;
+	}
+	char *text = arenaCreate(len + 1);
+	memcpy(text, buf, len);
+	memFree(buf);
+	*size = len;
+	return text;
+}
+
+bool loadDocument(Document *doc, const char *filename)
+{
+	FILE *file = fopen(filename, "rb");
+	if (!file)
+		return false;
+
+	// the whole file goes into one arena and lines point straight into it until they need to grow
+	long long size = -1;
+	bool moved = !_fseeki64(file, 0, SEEK_END);
+	if (moved)
+		size = _ftelli64(file);
+	// stuck at the end the load would come up empty and the next save would wipe the file
+	if (moved && _fseeki64(file, 0, SEEK_SET))
+	{
+		fclose(file);
+		return false;
+	}
+	char *text;
+	if (size >= 0)
+	{
+		text = arenaCreate(size + 1);
+		size = fread(text, 1, size, file);
+		if (ferror(file))
+		{
+			arenaRelease(text);
+			text = NULL;
+		}
+	}
+	else
+		text = readStream(file, &size);
+	fclose(file);
+	if (text == NULL)
+		return false;
+	text[size] = '\0';
+	memFree(doc->filename);
+	memFree(doc->path);
+	doc->filename = memStrdup(MEM_FILE, filename);
+	doc->path = fullPath(filename);
+
+	int count = 0;
+	for (char *p = text; (p = memchr(p, '\n', text + size - p)); p++)
+		count++;
+	if (size && text[size - 1] != '\n')
+		count++; // last line without a trailing newline
+	if (!count)
+	{
+		arenaRelease(text);
+		return true;
+	}
+	if ((doc->lines = memRealloc(MEM_LINES, doc->lines, sizeof(Line) * (doc->num_lines + count))) == NULL)
+		die("Failed to load file");
+
+	slabs.arenas[slabs.num_arenas - 1].refs = count;
+	for (char *start = text; start < text + size;)
+	{
+		char *end = memchr(start, '\n', text + size - start);
+		char *next = end ? end + 1 : text + size;
+		if (!end)
+			end = text + size;
+		while (end > start && (end[-1] == '\n' || end[-1] == '\r')) // reduce size so string will be truncated when '\0' is inserted at the end
+			end--;
+		*end = '\0';
+
+		Line *line = &doc->lines[doc->num_lines++];
+		*line = (Line){end - start, 0, start, NULL, 0, 0};
+		updateLine(line);
+		indexLine(line, 1);
+		start = next;
+	}
+	return true;
+}
+
+Document *findDocument(const char *filename)
+{
+	char *path = fullPath(filename);
+	Document *found = NULL;
+	for (int i = 0; i < editor.num_documents && !found; i++)
+		if (editor.documents[i]->path && !_stricmp(editor.documents[i]->path, path))
+			found = editor.documents[i];
+	memFree(path);
+	return found;
+}
+
+void saveToDisk()
+{
+	if (!editor.doc->filename)
+	{
+		char *filename = prompt("Save As: %s");
+		if (filename == NULL)
+		{
+			setStatusMessage("Save aborted");
+			return;
+		}
+		// a second document for the same file would stop its views sharing lines and the two saves would clobber each other
+		if (findDocument(filename))
+		{
+			setStatusMessage("Save aborted - %s is already open in another buffer", filename);
+			memFree(filename);
+			return;
+		}
+		editor.doc->filename = filename;
+		editor.doc->path = fullPath(filename);
+	}
+	int len = 0;
+	for (int i = 0; i < editor.doc->num_lines; i++)
+		len += editor.doc->lines[i].len + 1; // add one for new line
+
+	char *full_text = memAlloc(MEM_FILE, len);
+	char *ptr = full_text;
+	for (int i = 0; i < editor.doc->num_lines; i++)
+	{
+		memcpy(ptr, editor.doc->lines[i].chars, editor.doc->lines[i].len);
+		ptr += editor.doc->lines[i].len; // go to last index
+		*ptr = '\n';				// append new line
+		ptr++;						// append from after this
+	}
+	*ptr = '\0';
+	// die(full_text);
+	//  int *file_handle;
+	//  if(_sopen_s(&file_handle, editor.doc->filename, _O_RDWR | _O_CREAT | _O_BINARY, _SH_DENYNO, _S_IREAD | _S_IWRITE))
+	//  	die("Couldn't save to Disk");
+	HANDLE file_handle = CreateFileA(editor.doc->filename, GENERIC_READ | GENERIC_WRITE, 0, NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file_handle == INVALID_HANDLE_VALUE)
+	{
+		CloseHandle(file_handle);
+		die("Couldn't write to disk - File couldn't be opened");
+	}
+	LARGE_INTEGER li;
+	li.QuadPart = len;
+	if (!SetFilePointerEx(file_handle, li, NULL, FILE_BEGIN))
+	{
+		memFree(full_text);
+		CloseHandle(file_handle);
+		setStatusMessage(ErrorExit());
+		return;
+	}
+
+	if (!SetEndOfFile(file_handle))
+	{
+		memFree(full_text);
+		CloseHandle(file_handle);
+		setStatusMessage(ErrorExit());
+		return;
+	}
+
+	li.QuadPart = 0;
+	if (!SetFilePointerEx(file_handle, li, NULL, FILE_BEGIN))
+	{
+		memFree(full_text);
+		CloseHandle(file_handle);
+		setStatusMessage(ErrorExit());
+		return;
+	}
+
+	if (!WriteFile(file_handle, full_text, len, NULL, NULL))
+	{
+		memFree(full_text);
+		CloseHandle(file_handle);
+		setStatusMessage(ErrorExit());
+		return;
+	}
+
+	memFree(full_text);
+	CloseHandle(file_handle);
+	editor.doc->dirty = false;
+	setStatusMessage("Wrote %d bytes to file: %s", len, editor.doc->filename);
+}
+
+/*** BUFFERS AND VIEWS ***/
+Document *newDocument()
+{
+	Document *doc = memCalloc(MEM_VIEWS, 1, sizeof(Document));
+	if (doc == NULL)
+		die("Out of memory");
+	return doc;
+}
+
+void addDocument(Document *doc)
+{
+	Document **documents = memRealloc(MEM_VIEWS, editor.documents, sizeof(Document *) * (editor.num_documents + 1));
+	if (documents == NULL)
+		die("Out of memory");
+	editor.documents = documents;
+	editor.documents[editor.num_documents++] = doc;
+}
+
+View *newView(Document *doc)
+{
+	View *view = memCalloc(MEM_VIEWS, 1, sizeof(View));
+	if (view == NULL)
+		die("Out of memory");
+	view->doc = doc;
+	return view;
+}
+
+void focusView(View *view)
+{
+	editor.view = view;
+	editor.doc = view->doc;
+}
+
+// a view remembers nothing about documents it showed before, the document keeps the cursor it was left at
+void showDocument(View *view, Document *doc)
+{
+	view->doc->last_x = view->cursor_x;
+	view->doc->last_y = view->cursor_y;
+	memFree(view->cursors);
+	*view = (View){.doc = doc, .cursor_x = doc->last_x, .cursor_y = doc->last_y, .top = view->top, .left = view->left, .rows = view->rows, .cols = view->cols, .drawn_row_offset = -1};
+	if (editor.view == view)
+		editor.doc = doc;
+}
+
+// splits are kept in one array, node 0 is the root and leaves hold a view
+int addSplit(int parent, View *view)
+{
+	for (int i = 1; i < editor.num_splits; i++)
+		if (editor.splits[i].parent == -1)
+		{
+			editor.splits[i] = (Split){parent, {-1, -1}, false, view};
+			return i;
+		}
+	Split *splits = memRealloc(MEM_VIEWS, editor.splits, sizeof(Split) * (editor.num_splits + 1));
+	if (splits == NULL)
+		die("Out of memory");
+	editor.splits = splits;
+	editor.splits[editor.num_splits] = (Split){parent, {-1, -1}, false, view};
+	return editor.num_splits++;
+}
+
+void initViews()
+{
+	Document *doc = newDocument();
+	addDocument(doc);
+	View *view = newView(doc);
+	addSplit(-1, view);
+	focusView(view);
+}
+
+void layoutSplit(int node, int top, int left, int rows, int cols)
+{
+	Split *split = &editor.splits[node];
+	split->top = top;
+	split->left = left;
+	split->rows = rows;
+	split->cols = cols;
+	if (split->view)
+	{
+		// last row of every view is its own bar
+		split->view->top = top;
+		split->view->left = left;
+		split->view->rows = rows > 1 ? rows - 1 : 1;
+		split->view->cols = cols > 0 ? cols : 1;
+		split->view->drawn_row_offset = -1;
+		return;
+	}
+	if (split->vertical)
+	{
+		int first = (cols - 1) / 2; // one column between the two for the divider
+		layoutSplit(split->children[0], top, left, rows, first);
+		layoutSplit(split->children[1], top, left + first + 1, rows, cols - first - 1);
+	}
+	else
+	{
+		int first = rows / 2;
+		layoutSplit(split->children[0], top, left, first, cols);
+		layoutSplit(split->children[1], top + first, left, rows - first, cols);
+	}
+}
+
+void layoutViews()
+{
+	layoutSplit(0, 0, 0, editor.screen_rows - 1, editor.screen_cols); // bottom row is the status bar
+}
+
+int findSplit(View *view)
+{
+	for (int i = 0; i < editor.num_splits; i++)
+		if (editor.splits[i].view == view)
+			return i;
+	return 0;
+}
+
+// the new view shows the same document with its own cursor, starting where the old one was
+void splitView(bool vertical)
+{
+	int node = findSplit(editor.view);
+	if (vertical ? editor.splits[node].cols < 3 : editor.splits[node].rows < 4)
+	{
+		setStatusMessage("Not enough room to split");
+		return;
+	}
+	View *view = newView(editor.doc);
+	view->cursor_x = editor.view->cursor_x;
+	view->cursor_y = editor.view->cursor_y;
+	view->row_offset = editor.view->row_offset;
+	view->col_offset = editor.view->col_offset;
+
+	int first = addSplit(node, view), second = addSplit(node, editor.view);
+	Split *split = &editor.splits[node];
+	split->view = NULL;
+	split->vertical = vertical;
+	split->children[0] = first;
+	split->children[1] = second;
+	layoutViews();
+	focusView(view);
+}
+
+int firstLeaf(int node)
+{
+	while (!editor.splits[node].view)
+		node = editor.splits[node].children[0];
+	return node;
+}
+
+void closeView()
+{
+	if (editor.splits[0].view)
+	{
+		setStatusMessage("Can't close the last view");
+		return;
+	}
+	int node = findSplit(editor.view);
+	int parent = editor.splits[node].parent;
+	int sibling = editor.splits[parent].children[editor.splits[parent].children[0] == node];
+
+	// the sibling takes the parent's place so the rest of the tree keeps its indices
+	int grandparent = editor.splits[parent].parent;
+	editor.splits[parent] = editor.splits[sibling];
+	editor.splits[parent].parent = grandparent;
+	for (int i = 0; i < 2; i++)
+		if (editor.splits[parent].children[i] >= 0)
+			editor.splits[editor.splits[parent].children[i]].parent = parent;
+	editor.splits[node] = editor.splits[sibling] = (Split){-1, {-1, -1}, false, NULL};
+
+	View *view = editor.view;
+	view->doc->last_x = view->cursor_x;
+	view->doc->last_y = view->cursor_y;
+	memFree(view->cursors);
+	memFree(view);
+	layoutViews();
+	focusView(editor.splits[firstLeaf(parent)].view);
+}
+
+// leaves in order, left to right and top to bottom
+void nextView()
+{
+	int node = findSplit(editor.view);
+	while (editor.splits[node].parent >= 0)
+	{
+		Split *parent = &editor.splits[editor.splits[node].parent];
+		if (parent->children[0] == node)
+		{
+			focusView(editor.splits[firstLeaf(parent->children[1])].view);
+			return;
+		}
+		node = editor.splits[node].parent;
+	}
+	focusView(editor.splits[firstLeaf(0)].view);
+}
+
+void switchBuffer(int step)
+{
+	if (editor.num_documents < 2)
+	{
+		setStatusMessage("No other buffers open");
+		return;
+	}
+	int i = 0;
+	while (editor.documents[i] != editor.doc)
+		i++;
+	i = (i + step + editor.num_documents) % editor.num_documents;
+	showDocument(editor.view, editor.documents[i]);
+	setStatusMessage("Buffer %d of %d: %s", i + 1, editor.num_documents, editor.doc->filename ? editor.doc->filename : "[No Name]");
+}
+
+// a file that is already open is shown from the same document, so every view of it sees the same lines
+Document *openDocument(const char *filename)
+{
+	Document *doc = findDocument(filename);
+	if (doc)
+		return doc;
+
+	// an untouched empty buffer is reused instead of piling up behind the new one
+	doc = editor.doc;
+	bool fresh = doc->filename || doc->num_lines || doc->dirty;
+	if (fresh)
+		doc = newDocument();
+	if (!loadDocument(doc, filename))
+	{
+		if (fresh)
+			memFree(doc);
+		return NULL;
+	}
+	if (fresh)
+		addDocument(doc);
+	return doc;
+}
+
+void openFile()
+{
+	char *filename = prompt("Open: %s");
+	if (filename == NULL)
+		return;
+	Document *doc = openDocument(filename);
+	if (doc == NULL)
+		setStatusMessage("Could not open file: %s", filename);
+	else if (doc != editor.doc)
+		showDocument(editor.view, doc);
+	memFree(filename);
+}
+
+// CTRL-W is a prefix for the view and buffer commands, like the window commands of vi
+void windowCommand()
+{
+	setStatusMessage("CTRL-W: s Split - v Vertical Split - w Next View - c Close View - n/p Next/Previous Buffer - o Open");
+	refreshScreen();
+	int c = readKey();
+	setStatusMessage("");
+	switch (c)
+	{
+	case 's':
+		splitView(false);
+		break;
+	case 'v':
+		splitView(true);
+		break;
+	case 'w':
+	case CTRL_KEY('w'):
+		nextView();
+		break;
+	case 'c':
+		closeView();
+		break;
+	case 'n':
+		switchBuffer(1);
+		break;
+	case 'p':
+		switchBuffer(-1);
+		break;
+	case 'o':
+		openFile();
+		break;
+	}
+}
+
+/*** THREADS ***/
+int cpuCount()
+{
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	int count = info.dwNumberOfProcessors;
+	return clamp(&count, 1, MAX_THREADS);
+}
+
+// runs worker once per job, each on its own thread except the first which runs on the caller's
+void runJobs(LPTHREAD_START_ROUTINE worker, void *jobs, size_t size, int num_jobs)
+{
+	HANDLE handles[MAX_THREADS];
+	int num_handles = 0;
+	for (int i = 1; i < num_jobs; i++)
+	{
+		HANDLE handle = CreateThread(NULL, 0, worker, (char *)jobs + size * i, 0, NULL);
+		if (handle)
+			handles[num_handles++] = handle;
+		else
+			worker((char *)jobs + size * i);
+	}
+	if (num_jobs)
+		worker(jobs);
+	if (num_handles)
+		WaitForMultipleObjects(num_handles, handles, TRUE, INFINITE);
+	for (int i = 0; i < num_handles; i++)
+		CloseHandle(handles[i]);
+}
+
+/*** REGEX SEARCH ***/
+// patterns are parsed into a small syntax tree, compiled to Thompson NFAs and matched with lazily built DFAs,
+// so matching is linear in the line length no matter the pattern
+#define SET_HAS(set, c) ((set)[(unsigned char)(c) >> 3] & (1 << ((unsigned char)(c) & 7)))
+#define SET_ADD(set, c) ((set)[(unsigned char)(c) >> 3] |= (1 << ((unsigned char)(c) & 7)))
+
+enum RegexNodeType
+{
+	RE_SET,
+	RE_EMPTY,
+	RE_CAT,
+	RE_ALT,
+	RE_STAR,
+	RE_PLUS,
+	RE_QUEST
+};
+
+typedef struct RegexNode
+{
+	int type;
+	int left, right;
+	unsigned char set[32]; // bytes matched by an RE_SET node
+} RegexNode;
+
+enum NfaStateType
+{
+	NFA_MATCH,
+	NFA_SET,
+	NFA_SPLIT // epsilon moves to out and, unless it is -1, out1
+};
+
+typedef struct NfaState
+{
+	int type;
+	int out, out1;
+	unsigned char set[32];
+} NfaState;
+
+typedef struct Nfa
+{
+	NfaState *states;
+	int num_states, start;
+} Nfa;
+
+typedef struct DfaState
+{
+	int set, num; // nfa states making up this dfa state, stored at sets[set]
+	bool accepting;
+	int next[256]; // -1 until the transition is first taken
+} DfaState;
+
+typedef struct Dfa
+{
+	const Nfa *nfa;
+	bool unanchored; // the nfa start state is re-entered on every byte so a match can begin anywhere
+	DfaState *states;
+	int num_states, cap_states;
+	int *sets;
+	int sets_len, sets_cap;
+	int *table; // open addressing hash of state index + 1, 0 is empty
+	int *start_set, start_num, start;
+	int *stack, *scratch, num_scratch, *mark, generation;
+} Dfa;
+
+typedef struct Regex
+{
+	RegexNode *nodes;
+	int num_nodes, root;
+	bool anchor_start, anchor_end;
+	char prefix[64]; // literal every match begins with, used to skip ahead with memchr
+	int prefix_len;
+	Nfa forward, reverse;
+} Regex;
+
+// each search thread owns its own dfa caches, the nfas they are built from are shared and read only
+typedef struct Matcher
+{
+	Dfa search, reverse, longest;
+} Matcher;
+
+typedef struct RegexParser
+{
+	Regex *re;
+	const char *p, *end;
+	const char *error;
+} RegexParser;
+
+int regexNode(Regex *re, int type, int left, int right)
+{
+	if ((re->nodes = memRealloc(MEM_SEARCH, re->nodes, sizeof(RegexNode) * (re->num_nodes + 1))) == NULL)
+		die("Failed to compile regex");
+	re->nodes[re->num_nodes] = (RegexNode){.type = type, .left = left, .right = right};
+	return re->num_nodes++;
+}
+
+void escapeSet(unsigned char *set, char c)
+{
+	unsigned char sub[32] = {0};
+	switch (c)
+	{
+	case 'd':
+	case 'D':
+		for (int i = '0'; i <= '9'; i++)
+			SET_ADD(sub, i);
+		break;
+	case 'w':
+	case 'W':
+		for (int i = 0; i < 256; i++)
+			if (isalnum(i) || i == '_')
+				SET_ADD(sub, i);
+		break;
+	case 's':
+	case 'S':
+		for (const char *s = " \t\r\n\f\v"; *s; s++)
+			SET_ADD(sub, *s);
+		break;
+	case 't':
+		SET_ADD(sub, '\t');
+		break;
+	case 'n':
+		SET_ADD(sub, '\n');
+		break;
+	default:
+		SET_ADD(sub, c);
+		break;
+	}
+	bool negate = c == 'D' || c == 'W' || c == 'S';
+	for (int i = 0; i < 32; i++)
+		set[i] |= negate ? ~sub[i] : sub[i];
+}
+
+int parseAlt(RegexParser *p);
+
+int parseClass(RegexParser *p)
+{
+	int node = regexNode(p->re, RE_SET, -1, -1);
+	unsigned char set[32] = {0};
+	bool negate = p->p < p->end && *p->p == '^';
+	if (negate)
+		p->p++;
+	for (bool first = true; p->p < p->end && (*p->p != ']' || first); first = false)
+	{
+		unsigned char lo = *p->p++;
+		if (lo == '\\' && p->p < p->end)
+			escapeSet(set, *p->p++);
+		else if (p->p + 1 < p->end && *p->p == '-' && p->p[1] != ']')
+		{
+			unsigned char hi = p->p[1];
+			p->p += 2;
+			if (hi < lo)
+				p->error = "bad range in []";
+			for (int c = lo; c <= hi; c++)
+				SET_ADD(set, c);
+		}
+		else
+			SET_ADD(set, lo);
+	}
+	if (p->p == p->end)
+		p->error = "missing ]";
+	else
+		p->p++;
+	for (int i = 0; i < 32; i++)
+		p->re->nodes[node].set[i] = negate ? ~set[i] : set[i];
+	return node;
+}
+
+int parseAtom(RegexParser *p)
+{
+	if (p->p == p->end || strchr("*+?", *p->p))
+	{
+		p->error = "nothing to repeat";
+		return regexNode(p->re, RE_EMPTY, -1, -1);
+	}
+	char c = *p->p++;
+	if (c == '(')
+	{
+		int node = parseAlt(p);
+		if (p->p == p->end || *p->p != ')')
+			p->error = "missing )";
+		else
+			p->p++;
+		return node;
+	}
+	if (c == '[')
+		return parseClass(p);
+
+	int node = regexNode(p->re, RE_SET, -1, -1);
+	if (c == '.')
+		memset(p->re->nodes[node].set, 0xff, 32);
+	else if (c == '\\' && p->p < p->end)
+		escapeSet(p->re->nodes[node].set, *p->p++);
+	else
+		SET_ADD(p->re->nodes[node].set, c);
+	return node;
+}
+
+int parseRepeat(RegexParser *p)
+{
+	int node = parseAtom(p);
+	while (!p->error && p->p < p->end && strchr("*+?", *p->p))
+	{
+		int type = *p->p == '*' ? RE_STAR : (*p->p == '+' ? RE_PLUS : RE_QUEST);
+		p->p++;
+		node = regexNode(p->re, type, node, -1);
+	}
+	return node;
+}
+
+int parseConcat(RegexParser *p)
+{
+	int node = regexNode(p->re, RE_EMPTY, -1, -1);
+	while (!p->error && p->p < p->end && *p->p != '|' && *p->p != ')')
+	{
+		int right = parseRepeat(p);
+		node = regexNode(p->re, RE_CAT, node, right);
+	}
+	return node;
+}
+
+int parseAlt(RegexParser *p)
+{
+	int node = parseConcat(p);
+	while (!p->error && p->p < p->end && *p->p == '|')
+	{
+		p->p++;
+		int right = parseConcat(p);
+		node = regexNode(p->re, RE_ALT, node, right);
+	}
+	return node;
+}
+
+int nfaState(Nfa *nfa, int type, int out, int out1, const unsigned char *set)
+{
+	if ((nfa->states = memRealloc(MEM_SEARCH, nfa->states, sizeof(NfaState) * (nfa->num_states + 1))) == NULL)
+		die("Failed to compile regex");
+	nfa->states[nfa->num_states] = (NfaState){.type = type, .out = out, .out1 = out1};
+	if (set)
+		memcpy(nfa->states[nfa->num_states].set, set, 32);
+	return nfa->num_states++;
+}
+
+// builds the states for node so that they continue to next, returns the state to enter them from
+int nfaEmit(Regex *re, Nfa *nfa, int node, int next, bool reverse)
+{
+	RegexNode n = re->nodes[node];
+	switch (n.type)
+	{
+	case RE_SET:
+		return nfaState(nfa, NFA_SET, next, -1, re->nodes[node].set);
+	case RE_CAT:
+		// a reversed pattern matches the line read backwards, so concatenations flip
+		if (reverse)
+			return nfaEmit(re, nfa, n.right, nfaEmit(re, nfa, n.left, next, reverse), reverse);
+		return nfaEmit(re, nfa, n.left, nfaEmit(re, nfa, n.right, next, reverse), reverse);
+	case RE_ALT:
+	{
+		int left = nfaEmit(re, nfa, n.left, next, reverse);
+		int right = nfaEmit(re, nfa, n.right, next, reverse);
+		return nfaState(nfa, NFA_SPLIT, left, right, NULL);
+	}
+	case RE_QUEST:
+		return nfaState(nfa, NFA_SPLIT, nfaEmit(re, nfa, n.left, next, reverse), next, NULL);
+	case RE_STAR:
+	case RE_PLUS:
+	{
+		int loop = nfaState(nfa, NFA_SPLIT, -1, next, NULL);
+		int body = nfaEmit(re, nfa, n.left, loop, reverse);
+		nfa->states[loop].out = body;
+		return n.type == RE_STAR ? loop : body;
+	}
+	}
+	return next; // RE_EMPTY
+}
+
+void nfaCompile(Regex *re, Nfa *nfa, bool reverse)
+{
+	nfa->states = NULL;
+	nfa->num_states = 0;
+	nfaState(nfa, NFA_MATCH, -1, -1, NULL); // state 0 is always the match state
+	nfa->start = nfaEmit(re, nfa, re->root, 0, reverse);
+}
+
+// collects the literal bytes every match has to start with, returns false once it stops being a plain literal
+bool regexPrefix(Regex *re, int node)
+{
+	RegexNode *n = &re->nodes[node];
+	if (n->type == RE_EMPTY)
+		return true;
+	if (n->type == RE_CAT)
+		return regexPrefix(re, n->left) && regexPrefix(re, n->right);
+	if (n->type != RE_SET || re->prefix_len == sizeof(re->prefix))
+		return false;
+	int count = 0, c = 0;
+	for (int i = 0; i < 256 && count < 2; i++)
+		if (SET_HAS(n->set, i))
+			count++, c = i;
+	if (count != 1)
+		return false;
+	re->prefix[re->prefix_len++] = c;
+	return true;
+}
+
+void regexFree(Regex *re)
+{
+	memFree(re->nodes);
+	memFree(re->forward.states);
+	memFree(re->reverse.states);
+	*re = (Regex){0};
+}
+
+// ^ and $ are only supported at the very start and end of the pattern
+bool regexCompile(Regex *re, const char *pattern, const char **error)
+{
+	*re = (Regex){0};
+	int len = strlen(pattern);
+	int backslashes = 0;
+	for (int i = len - 2; i >= 0 && pattern[i] == '\\'; i--)
+		backslashes++;
+	re->anchor_start = len && pattern[0] == '^';
+	re->anchor_end = len > re->anchor_start && pattern[len - 1] == '$' && backslashes % 2 == 0;
+
+	RegexParser p = {re, pattern + re->anchor_start, pattern + len - re->anchor_end, NULL};
+	re->root = parseAlt(&p);
+	if (!p.error && p.p != p.end)
+		p.error = "unmatched )";
+	if (p.error)
+	{
+		*error = p.error;
+		regexFree(re);
+		return false;
+	}
+	if (!re->anchor_start)
+		regexPrefix(re, re->root);
+	nfaCompile(re, &re->forward, false);
+	nfaCompile(re, &re->reverse, true);
+	return true;
+}
+
+// adds the states reachable from state through epsilon moves to the scratch set
+void dfaClosure(Dfa *dfa, int state)
+{
+	int top = 0;
+	if (state < 0 || dfa->mark[state] == dfa->generation)
+		return;
+	dfa->mark[state] = dfa->generation;
+	dfa->stack[top++] = state;
+	while (top)
+	{
+		const NfaState *s = &dfa->nfa->states[dfa->stack[--top]];
+		if (s->type != NFA_SPLIT)
+		{
+			dfa->scratch[dfa->num_scratch++] = s - dfa->nfa->states;
+			continue;
+		}
+		int outs[2] = {s->out, s->out1};
+		for (int i = 0; i < 2; i++)
+			if (outs[i] >= 0 && dfa->mark[outs[i]] != dfa->generation)
+			{
+				dfa->mark[outs[i]] = dfa->generation;
+				dfa->stack[top++] = outs[i];
+			}
+	}
+}
+
+int compareInts(const void *a, const void *b)
+{
+	return *(const int *)a - *(const int *)b;
+}
+
+// finds or creates the dfa state for a set of nfa states, -1 when the cache is full
+int dfaAdd(Dfa *dfa, int *set, int num)
+{
+	qsort(set, num, sizeof(int), compareInts);
+	unsigned hash = 2166136261u;
+	for (int i = 0; i < num; i++)
+		hash = (hash ^ set[i]) * 16777619u;
+
+	int slot = hash & (REGEX_DFA_TABLE_SIZE - 1);
+	for (; dfa->table[slot]; slot = (slot + 1) & (REGEX_DFA_TABLE_SIZE - 1))
+	{
+		DfaState *s = &dfa->states[dfa->table[slot] - 1];
+		if (s->num == num && !memcmp(&dfa->sets[s->set], set, sizeof(int) * num))
+			return dfa->table[slot] - 1;
+	}
+	if (dfa->num_states == REGEX_MAX_DFA_STATES)
+		return -1;
+
+	if (dfa->num_states == dfa->cap_states)
+	{
+		dfa->cap_states = dfa->cap_states ? dfa->cap_states * 2 : 16;
+		if ((dfa->states = memRealloc(MEM_SEARCH, dfa->states, sizeof(DfaState) * dfa->cap_states)) == NULL)
+			die("Failed to grow regex cache");
+	}
+	if (dfa->sets_len + num > dfa->sets_cap)
+	{
+		dfa->sets_cap = (dfa->sets_len + num) * 2;
+		if ((dfa->sets = memRealloc(MEM_SEARCH, dfa->sets, sizeof(int) * dfa->sets_cap)) == NULL)
+			die("Failed to grow regex cache");
+	}
+	DfaState *s = &dfa->states[dfa->num_states];
+	s->set = dfa->sets_len;
+	s->num = num;
+	s->accepting = num && set[0] == 0; // sorted, so the match state comes first
+	memset(s->next, -1, sizeof(s->next));
+	memcpy(&dfa->sets[dfa->sets_len], set, sizeof(int) * num);
+	dfa->sets_len += num;
+	dfa->table[slot] = dfa->num_states + 1;
+	return dfa->num_states++;
+}
+
+// drops every cached state so memory stays bounded on patterns that blow up
+void dfaFlush(Dfa *dfa)
+{
+	dfa->num_states = 0;
+	dfa->sets_len = 0;
+	memset(dfa->table, 0, sizeof(int) * REGEX_DFA_TABLE_SIZE);
+	dfa->start = dfaAdd(dfa, dfa->start_set, dfa->start_num);
+}
+
+void dfaInit(Dfa *dfa, const Nfa *nfa, bool unanchored)
+{
+	*dfa = (Dfa){.nfa = nfa, .unanchored = unanchored};
+	dfa->table = memCalloc(MEM_SEARCH, REGEX_DFA_TABLE_SIZE, sizeof(int));
+	dfa->stack = memAlloc(MEM_SEARCH, sizeof(int) * nfa->num_states);
+	dfa->scratch = memAlloc(MEM_SEARCH, sizeof(int) * nfa->num_states);
+	dfa->start_set = memAlloc(MEM_SEARCH, sizeof(int) * nfa->num_states);
+	dfa->mark = memCalloc(MEM_SEARCH, nfa->num_states, sizeof(int));
+	if (!dfa->table || !dfa->stack || !dfa->scratch || !dfa->start_set || !dfa->mark)
+		die("Failed to create regex cache");
+
+	dfa->generation++;
+	dfaClosure(dfa, nfa->start);
+	dfa->start_num = dfa->num_scratch;
+	memcpy(dfa->start_set, dfa->scratch, sizeof(int) * dfa->num_scratch);
+	dfa->start = dfaAdd(dfa, dfa->start_set, dfa->start_num);
+}
+
+void dfaFree(Dfa *dfa)
+{
+	memFree(dfa->states);
+	memFree(dfa->sets);
+	memFree(dfa->table);
+	memFree(dfa->stack);
+	memFree(dfa->scratch);
+	memFree(dfa->start_set);
+	memFree(dfa->mark);
+	*dfa = (Dfa){0};
+}
+
+int dfaStep(Dfa *dfa, int state, unsigned char c)
+{
+	int next = dfa->states[state].next[c];
+	if (next >= 0)
+		return next;
+
+	dfa->generation++;
+	dfa->num_scratch = 0;
+	const int *set = &dfa->sets[dfa->states[state].set];
+	for (int i = 0; i < dfa->states[state].num; i++)
+	{
+		const NfaState *s = &dfa->nfa->states[set[i]];
+		if (s->type == NFA_SET && SET_HAS(s->set, c))
+			dfaClosure(dfa, s->out);
+	}
+	if (dfa->unanchored)
+		dfaClosure(dfa, dfa->nfa->start);
+
+	if ((next = dfaAdd(dfa, dfa->scratch, dfa->num_scratch)) >= 0)
+	{
+		dfa->states[state].next[c] = next;
+		return next;
+	}
+	dfaFlush(dfa); // state is gone now, so this transition simply isn't cached
+	return dfaAdd(dfa, dfa->scratch, dfa->num_scratch);
+}
+
+void matcherInit(Matcher *m, const Regex *re)
+{
+	dfaInit(&m->search, &re->forward, !re->anchor_start);
+	dfaInit(&m->reverse, &re->reverse, !re->anchor_end);
+	dfaInit(&m->longest, &re->forward, false);
+}
+
+void matcherFree(Matcher *m)
+{
+	dfaFree(&m->search);
+	dfaFree(&m->reverse);
+	dfaFree(&m->longest);
+}
+
+// cheap yes/no pass over s[from, len) that every line goes through before a match is located
+bool regexHasMatch(const Regex *re, Matcher *m, const char *s, int len, int from)
+{
+	if (from > len || (re->anchor_start && from > 0))
+		return false;
+	Dfa *dfa = &m->search;
+	int state = dfa->start;
+	for (int i = from; i < len; i++)
+	{
+		if (dfa->states[state].accepting && !re->anchor_end)
+			return true;
+		// no partial match is in flight, so nothing can start before the next copy of the prefix
+		if (state == dfa->start && re->prefix_len)
+		{
+			const char *p = s + i;
+			while ((p = memchr(p, re->prefix[0], len - (p - s))) && (len - (p - s) < re->prefix_len || memcmp(p, re->prefix, re->prefix_len)))
+				if (len - (++p - s) < re->prefix_len)
+					return false;
+			if (!p)
+				return false;
+			i = p - s;
+		}
+		state = dfaStep(dfa, state, s[i]);
+		if (!dfa->states[state].num)
+			return false; // dead state, only reachable when anchored
+	}
+	return dfa->states[state].accepting;
+}
+
+// finds the leftmost match starting at or after from and extends it as far as it goes
+bool regexLocate(const Regex *re, Matcher *m, const char *s, int len, int from, int *start, int *end)
 {
-	if (index < 0 || index > line->len)
-		index = line->len;
-
-	line->chars = realloc(line->chars, line->len + 2);
-	memmove(&line->chars[index + 1], &line->chars[index], line->len - index + 1); // + 1 to move null terminator
+	if (!regexHasMatch(re, m, s, len, from))
+		return false;
+
+	// reading the line backwards with the reversed pattern, the last accepting position is the leftmost start
+	Dfa *dfa = &m->reverse;
+	int state = dfa->start;
+	*start = dfa->states[state].accepting ? len : -1;
+	for (int i = len - 1; i >= from; i--)
+	{
+		state = dfaStep(dfa, state, s[i]);
+		if (!dfa->states[state].num)
+			break;
+		if (dfa->states[state].accepting)
+			*start = i;
+	}
+	if (*start < 0 || (re->anchor_start && *start != 0))
+		return false;
+	if (re->anchor_end)
+	{
+		*end = len;
+		return true;
+	}
 
-	line->len++;
-	line->chars[index] = c;
-	updateLine(line);
-	editor.dirty = true;
+	dfa = &m->longest;
+	state = dfa->start;
+	*end = *start;
+	for (int i = *start; i < len; i++)
+	{
+		state = dfaStep(dfa, state, s[i]);
+		if (!dfa->states[state].num)
+			break;
+		if (dfa->states[state].accepting)
+			*end = i + 1;
+	}
+	return true;
 }
 
-void insert(char c)
+struct
 {
-	if (editor.cursor_y == editor.num_lines)
-		insertLine(editor.num_lines, "", 0);
-	lineInsert(&editor.lines[editor.cursor_y], editor.cursor_x++, c);
-}
+	Regex re;
+	bool compiled;
+	Matcher matchers[MAX_THREADS];
+	int num_matchers;
+} search = {.compiled = false, .num_matchers = 0};
+
+// lines are visited starting at the cursor's line and wrapping around, position k of that order
+// is line (start_y + k) % num_lines, and the cursor's line comes up again at the end for what's before the cursor
+typedef struct SearchJob
+{
+	Matcher *matcher;
+	int first, last;
+	int start_y, from;
+	int found; // first position in [first, last) with a match, -1 if there is none
+} SearchJob;
 
-void lineDelete(Line *line, int index)
+DWORD WINAPI searchWorker(LPVOID arg)
 {
-	if (index < 0 || index > line->len)
-		return;
-	memmove(&line->chars[index], &line->chars[index + 1], line->len-- - index);
-	updateLine(line);
-	editor.dirty = true;
+	SearchJob *job = arg;
+	for (int k = job->first; k < job->last; k++)
+	{
+		Line *line = &editor.doc->lines[(job->start_y + k) % editor.doc->num_lines];
+		if (regexHasMatch(&search.re, job->matcher, line->chars, line->len, k == 0 ? job->from : 0))
+		{
+			job->found = k;
+			break;
+		}
+	}
+	return 0;
 }
 
-void deleteRow(int index)
+void findMatch(int from)
 {
-	if (index < 0 || index > editor.num_lines)
+	if (!editor.doc->num_lines)
 		return;
-	free(editor.lines[index].chars);
-	free(editor.lines[index].rchars);
+	int start_y = editor.view->cursor_y < editor.doc->num_lines ? editor.view->cursor_y : 0;
+	int total = editor.doc->num_lines + 1;
+	int threads = editor.doc->num_lines >= SEARCH_PARALLEL_LINES ? search.num_matchers : 1;
+
+	SearchJob jobs[MAX_THREADS];
+	for (int t = 0; t < threads; t++)
+		jobs[t] = (SearchJob){&search.matchers[t], (long long)total * t / threads, (long long)total * (t + 1) / threads, start_y, from, -1};
+	runJobs(searchWorker, jobs, sizeof(SearchJob), threads);
 
-	memmove(&editor.lines[index], &editor.lines[index + 1], sizeof(Line) * (--editor.num_lines - index));
-	editor.dirty = true;
+	for (int t = 0; t < threads; t++)
+	{
+		if (jobs[t].found < 0)
+			continue;
+		int k = jobs[t].found, start, end;
+		int y = (start_y + k) % editor.doc->num_lines;
+		Line *line = &editor.doc->lines[y];
+		if (regexLocate(&search.re, &search.matchers[0], line->chars, line->len, k == 0 ? from : 0, &start, &end))
+		{
+			editor.view->cursor_y = y;
+			editor.view->cursor_x = start;
+			setStatusMessage("Match on line %d, col %d (%d chars)", y + 1, start, end - start);
+			return;
+		}
+	}
+	setStatusMessage("No match");
 }
 
-void appendToLine(Line *line, char *str, int len)
+bool compileSearch(const char *pattern)
 {
-	line->chars = realloc(line->chars, line->len + len + 1);
-	memcpy(&line->chars[line->len], str, len);
-	line->len += len;
-	line->chars[line->len] = '\0';
-	updateLine(line);
-	editor.dirty = true; // TODO come back later to delete if unnecessary
+	const char *error;
+	Regex re;
+	if (!regexCompile(&re, pattern, &error))
+	{
+		setStatusMessage("Bad regex: %s", error);
+		return false;
+	}
+	if (search.compiled)
+	{
+		for (int i = 0; i < search.num_matchers; i++)
+			matcherFree(&search.matchers[i]);
+		regexFree(&search.re);
+	}
+	if (!search.num_matchers)
+		search.num_matchers = cpuCount();
+	search.re = re;
+	search.compiled = true;
+	for (int i = 0; i < search.num_matchers; i++)
+		matcherInit(&search.matchers[i], &search.re);
+	return true;
 }
 
-void delete()
+void find()
 {
-	if (!editor.cursor_x && !editor.cursor_y)
+	char *pattern = prompt("Search (regex): %s (ESC to cancel)");
+	if (pattern == NULL)
 		return;
-	if (editor.cursor_x > 0)
-		lineDelete(&editor.lines[editor.cursor_y], --editor.cursor_x);
-	else
+	if (compileSearch(pattern))
+		findMatch(editor.view->cursor_x);
+	memFree(pattern);
+}
+
+void findNext()
+{
+	if (!search.compiled)
 	{
-		editor.cursor_y--;
-		editor.cursor_x = editor.lines[editor.cursor_y].len;
-		appendToLine(&editor.lines[editor.cursor_y], editor.lines[editor.cursor_y + 1].chars, editor.lines[editor.cursor_y + 1].len);
-		deleteRow(editor.cursor_y + 1);
+		setStatusMessage("Nothing to search for - use CTRL-F first");
+		return;
 	}
+	findMatch(editor.view->cursor_x + 1); // step past the current match so the same one isn't found again
 }
 
-// BASIC EDITOR FUNCTIONS
-char *ErrorExit()
+/*** BUFFER COMMANDS ***/
+// sort, uniq and filters build a new document and swap it in as one undoable replacement
+typedef struct SortItem
 {
-	DWORD err = GetLastError();
-	LPVOID msg;
-
-	FormatMessageA(
-		FORMAT_MESSAGE_ALLOCATE_BUFFER |
-			FORMAT_MESSAGE_FROM_SYSTEM |
-			FORMAT_MESSAGE_IGNORE_INSERTS,
-		NULL,
-		err,
-		MAKELANGID(LANG_NEUTRAL, SUBLANG_DEFAULT),
-		(LPSTR)&msg,
-		0,
-		NULL);
-	char *buffer;
-	sprintf(buffer, "GetLastError() - %lu: %s\n", err, (char *)msg);
-	LocalFree(msg);
-	return buffer;
-}
+	const char *chars;
+	int len;
+	double key; // leading number of the line for numeric sorts
+} SortItem;
 
-void die(const char *s, ...)
+struct
 {
-	va_list args;
-	va_start(args, s);
-	char message[128];
-	vsprintf(message, s, args); // error code from console
-	free(s);
-	va_end(args);
-	resetScreen();
+	bool numeric, reverse;
+} sort_options = {.numeric = false, .reverse = false};
 
-	HANDLE stdIn = GetStdHandle(STD_INPUT_HANDLE);
-	HANDLE stdOut = GetStdHandle(STD_OUTPUT_HANDLE);
+typedef struct SortJob
+{
+	SortItem *items;
+	int num_items;
+} SortJob;
 
-	WriteConsoleA(stdOut, "\x1b[?1049l", 8, NULL, NULL);
-	if (!SetConsoleMode(stdIn, editor.orig_in_mode) || !SetConsoleMode(stdOut, editor.orig_out_mode))
-		printf("%ld - ", GetLastError());
-	strcat(message, "\n");
-	perror(message);
-	printf(ErrorExit());
-	exit(1);
+typedef struct FilterJob
+{
+	Matcher matcher;
+	const Regex *re;
+	int first, last;
+	bool *keep;
+	bool drop;
+} FilterJob;
+
+Line copyLine(const char *chars, int len)
+{
+	Line line = {len, 0, NULL, NULL, 0, 0};
+	line.chars = textAlloc(MEM_LINES, len + 1, &line.cap);
+	memcpy(line.chars, chars, len);
+	line.chars[len] = '\0';
+	updateLine(&line);
+	return line;
 }
 
-void getWindowSize()
+void freeLines(Line *lines, int num_lines)
 {
-	CONSOLE_SCREEN_BUFFER_INFO console_info;
-	if (!GetConsoleScreenBufferInfo(GetStdHandle(STD_OUTPUT_HANDLE), &console_info))
-		die("Error on getting window size");
-
-	editor.cols = console_info.srWindow.Right - console_info.srWindow.Left + 1;
-	editor.rows = console_info.srWindow.Bottom - console_info.srWindow.Top + 1; // y increases as we go down so bottom minus top
+	for (int i = 0; i < num_lines; i++)
+		lineFree(&lines[i]);
+	memFree(lines);
+}
 
-	editor.rows -= 2;
+void swapDocument(Line **lines, int *num_lines)
+{
+	for (int i = 0; i < editor.doc->num_lines; i++)
+		indexLine(&editor.doc->lines[i], -1);
+	Line *old_lines = editor.doc->lines;
+	int old_num_lines = editor.doc->num_lines;
+	editor.doc->lines = *lines;
+	editor.doc->num_lines = *num_lines;
+	*lines = old_lines;
+	*num_lines = old_num_lines;
+	for (int i = 0; i < editor.doc->num_lines; i++)
+		indexLine(&editor.doc->lines[i], 1);
+
+	clearCursors();
+	clamp(&editor.view->cursor_y, 0, editor.doc->num_lines);
+	clamp(&editor.view->cursor_x, 0, editor.view->cursor_y < editor.doc->num_lines ? editor.doc->lines[editor.view->cursor_y].len : 0);
+	editor.doc->dirty = true;
 }
 
-void disableRawMode()
+void replaceDocument(Line *lines, int num_lines)
 {
-	HANDLE stdIn = GetStdHandle(STD_INPUT_HANDLE);
-	HANDLE stdOut = GetStdHandle(STD_OUTPUT_HANDLE);
+	if (editor.doc->can_undo)
+		freeLines(editor.doc->undo_lines, editor.doc->undo_num_lines);
+	swapDocument(&lines, &num_lines);
+	editor.doc->undo_lines = lines;
+	editor.doc->undo_num_lines = num_lines;
+	editor.doc->can_undo = true;
+}
 
-	WriteConsoleA(stdOut, "\x1b[?1049l", 8, NULL, NULL);
-	if (!SetConsoleMode(stdIn, editor.orig_in_mode) || !SetConsoleMode(stdOut, editor.orig_out_mode))
-		die("DisableRawMode(): Error on setting console mode.");
+// swaps back to the document before the last replacement, so pressing it again redoes
+void undo()
+{
+	if (!editor.doc->can_undo)
+	{
+		setStatusMessage("Nothing to undo");
+		return;
+	}
+	swapDocument(&editor.doc->undo_lines, &editor.doc->undo_num_lines);
+	setStatusMessage("Undone - CTRL-Z again to redo");
 }
 
-void enableRawMode()
+int compareSortItems(const void *a, const void *b)
 {
-	// tcgetattr
-	HANDLE stdIn = GetStdHandle(STD_INPUT_HANDLE);
-	HANDLE stdOut = GetStdHandle(STD_OUTPUT_HANDLE);
-	if (!GetConsoleMode(stdIn, &editor.orig_in_mode) || !GetConsoleMode(stdOut, &editor.orig_out_mode))
-		die("EnableRawMode(): Error on getting console mode.");
-	atexit(disableRawMode);
+	const SortItem *x = a, *y = b;
+	int result;
+	if (sort_options.numeric && x->key != y->key)
+		result = x->key < y->key ? -1 : 1;
+	else
+	{
+		result = memcmp(x->chars, y->chars, x->len < y->len ? x->len : y->len);
+		if (!result)
+			result = x->len - y->len;
+	}
+	return sort_options.reverse ? -result : result;
+}
 
-	DWORD rawIn = editor.orig_in_mode;
-	DWORD rawOut = editor.orig_out_mode;
-	// line input
-	rawIn &= ~(ENABLE_ECHO_INPUT | ENABLE_LINE_INPUT | ENABLE_PROCESSED_INPUT);
-	// input processing
-	rawIn |= ENABLE_EXTENDED_FLAGS;
-	rawIn &= ~ENABLE_QUICK_EDIT_MODE;
-	// output processing
-	rawOut |= ENABLE_PROCESSED_OUTPUT | ENABLE_VIRTUAL_TERMINAL_PROCESSING; // ViRTUAL_TERMINAL_PROCESSING allows ANSI escape characters
+// only a plain leading decimal number counts, like sort -n, so words such as inf or nan read as zero and no NaN reaches the comparator
+double numericKey(const char *chars, int len)
+{
+	int i = 0;
+	while (i < len && (chars[i] == ' ' || chars[i] == '\t'))
+		i++;
+	bool negative = i < len && chars[i] == '-';
+	if (negative)
+		i++;
+	double whole = 0, fraction = 0, scale = 1;
+	for (; i < len && isdigit((unsigned char)chars[i]); i++)
+		whole = whole * 10 + (chars[i] - '0');
+	if (i < len && chars[i] == '.')
+		for (i++; i < len && isdigit((unsigned char)chars[i]); i++)
+			fraction += (chars[i] - '0') * (scale /= 10);
+	return negative ? -(whole + fraction) : whole + fraction;
+}
 
-	if (!SetConsoleMode(stdIn, rawIn) || !SetConsoleMode(stdOut, rawOut))
-		die("EnableRawMode(): Error on setting console mode.");
+SortItem sortItem(const char *chars, int len)
+{
+	return (SortItem){chars, len, sort_options.numeric ? numericKey(chars, len) : 0};
 }
 
-void init()
+DWORD WINAPI sortWorker(LPVOID arg)
 {
-	HANDLE stdOut = GetStdHandle(STD_OUTPUT_HANDLE);
-	WriteConsoleA(stdOut, "\x1b[?1049h", 8, NULL, NULL);
-	resetScreen();
-	getWindowSize();
+	SortJob *job = arg;
+	qsort(job->items, job->num_items, sizeof(SortItem), compareSortItems);
+	return 0;
 }
 
-/*** FILE I/O ***/
-// have to make our own getline function since the original is for POSIX
-SSIZE_T getline(char **lineptr, size_t *lenptr, FILE *stream)
+// each thread sorts a slice, then slices are merged pairwise until one is left
+void sortItems(SortItem *items, int num_items)
 {
-	if (lineptr == NULL || lenptr == NULL || stream == NULL)
-		return -1;
-	char *buffer = *lineptr;
-	size_t len = *lenptr;
-	if (*lineptr == NULL || *lenptr == 0)
-	{
-		// make temp variables in case malloc doesn't work
-		// original values should remain if function fails
-		len = 128;
-		buffer = malloc(len);
-		if (!buffer)
-			return -1;
-		*lineptr = buffer;
-		*lenptr = len;
-	}
-	size_t i = 0;
-	for (int c = fgetc(stream); c != '\n'; c = fgetc(stream))
-	{
-		// this will let us make the end condition for the loop that collects all lines
-		if (c == EOF)
-		{
-			if (i == 0)
-				return -1;
-			break;
-		}
+	int threads = num_items >= SORT_PARALLEL_LINES ? cpuCount() : 1;
+	SortJob jobs[MAX_THREADS];
+	int bounds[MAX_THREADS + 1];
+	for (int t = 0; t <= threads; t++)
+		bounds[t] = (long long)num_items * t / threads;
+	for (int t = 0; t < threads; t++)
+		jobs[t] = (SortJob){&items[bounds[t]], bounds[t + 1] - bounds[t]};
+	runJobs(sortWorker, jobs, sizeof(SortJob), threads);
+	if (threads == 1)
+		return;
 
-		if (i >= len)
+	SortItem *src = items, *dst = memAlloc(MEM_COMMANDS, sizeof(SortItem) * num_items);
+	SortItem *scratch = dst;
+	if (dst == NULL)
+		die("Failed to sort");
+	for (int runs = threads; runs > 1;)
+	{
+		int merged = 0;
+		for (int r = 0; r < runs; r += 2)
 		{
-			len *= 2; // double length for resizing
-			char *newBuffer = realloc(buffer, len);
-			if (!newBuffer)
-				return -1;
-			*lineptr = buffer = newBuffer;
-			*lenptr = len;
+			int lo = bounds[r], mid = bounds[r + 1 < runs ? r + 1 : runs], hi = bounds[r + 2 < runs ? r + 2 : runs];
+			int i = lo, j = mid, k = lo;
+			while (i < mid && j < hi)
+				dst[k++] = compareSortItems(&src[j], &src[i]) < 0 ? src[j++] : src[i++];
+			memcpy(&dst[k], &src[i], sizeof(SortItem) * (mid - i));
+			memcpy(&dst[k + mid - i], &src[j], sizeof(SortItem) * (hi - j));
+			bounds[merged++] = lo;
 		}
-
-		buffer[i++] = (char)c;
+		bounds[merged] = num_items;
+		runs = merged;
+		SortItem *swap = src;
+		src = dst;
+		dst = swap;
 	}
-	buffer[i] = '\0';
-	return i;
+	if (src != items)
+		memcpy(items, src, sizeof(SortItem) * num_items);
+	memFree(scratch);
 }
 
-void openEditor(char *filename)
+void sortLines(bool numeric, bool reverse)
 {
-	free(editor.filename);
-	editor.filename = strdup(filename);
-	FILE *file = fopen(filename, "r");
-	if (!file)
-		die("Could not open file");
-
-	char *line = NULL;
-	size_t len = 0;
-	SSIZE_T llen; // line length
-	while ((llen = getline(&line, &len, file)) != -1)
-	{
-		while (llen > 0 && (line[llen - 1] == '\n' || line[llen - 1] == '\r')) // reduce size so string will be truncated when '\0' is inserted at llen
-			llen--;
-		insertLine(editor.num_lines, line, llen);
-	}
+	sort_options.numeric = numeric;
+	sort_options.reverse = reverse;
+	SortItem *items = memAlloc(MEM_COMMANDS, sizeof(SortItem) * (editor.doc->num_lines + 1));
+	Line *lines = memAlloc(MEM_COMMANDS, sizeof(Line) * (editor.doc->num_lines + 1));
+	if (items == NULL || lines == NULL)
+		die("Failed to sort");
+	for (int i = 0; i < editor.doc->num_lines; i++)
+		items[i] = sortItem(editor.doc->lines[i].chars, editor.doc->lines[i].len);
+
+	// the whole buffer is already in memory and stays there as the undo copy, so there is nothing to gain from spilling runs to disk
+	sortItems(items, editor.doc->num_lines);
+	for (int i = 0; i < editor.doc->num_lines; i++)
+		lines[i] = copyLine(items[i].chars, items[i].len);
+	memFree(items);
+
+	int num_lines = editor.doc->num_lines;
+	replaceDocument(lines, num_lines);
+	setStatusMessage("Sorted %d lines - CTRL-Z to undo", num_lines);
+}
 
-	free(line);
-	fclose(file);
+unsigned hashLine(const char *chars, int len)
+{
+	unsigned hash = 2166136261u;
+	for (int i = 0; i < len; i++)
+		hash = (hash ^ (unsigned char)chars[i]) * 16777619u;
+	return hash;
 }
 
-void saveToDisk()
+// keeps the first copy of every line wherever the duplicates are
+void uniqueLines()
 {
-	if (!editor.filename)
+	int size = 16;
+	while (size < editor.doc->num_lines * 2)
+		size *= 2;
+	int *table = memCalloc(MEM_COMMANDS, size, sizeof(int)); // line index + 1, 0 is empty
+	Line *lines = memAlloc(MEM_COMMANDS, sizeof(Line) * (editor.doc->num_lines + 1));
+	if (table == NULL || lines == NULL)
+		die("Failed to remove duplicates");
+
+	int num_lines = 0;
+	for (int i = 0; i < editor.doc->num_lines; i++)
 	{
-		editor.filename = prompt("Save As: %s");
-		if (editor.filename == NULL)
+		Line *line = &editor.doc->lines[i];
+		int slot = hashLine(line->chars, line->len) & (size - 1);
+		for (; table[slot]; slot = (slot + 1) & (size - 1))
 		{
-			setStatusMessage("Save aborted");
-			return;
+			Line *seen = &editor.doc->lines[table[slot] - 1];
+			if (seen->len == line->len && !memcmp(seen->chars, line->chars, line->len))
+				break;
 		}
+		if (table[slot])
+			continue;
+		table[slot] = i + 1;
+		lines[num_lines++] = copyLine(line->chars, line->len);
 	}
-	int len = 0;
-	for (int i = 0; i < editor.num_lines; i++)
-		len += editor.lines[i].len + 1; // add one for new line
+	memFree(table);
 
-	char *full_text = malloc(len);
-	char *ptr = full_text;
-	for (int i = 0; i < editor.num_lines; i++)
-	{
-		memcpy(ptr, editor.lines[i].chars, editor.lines[i].len);
-		ptr += editor.lines[i].len; // go to last index
-		*ptr = '\n';				// append new line
-		ptr++;						// append from after this
-	}
-	*ptr = '\0';
-	// die(full_text);
-	//  int *file_handle;
-	//  if(_sopen_s(&file_handle, editor.filename, _O_RDWR | _O_CREAT | _O_BINARY, _SH_DENYNO, _S_IREAD | _S_IWRITE))
-	//  	die("Couldn't save to Disk");
-	HANDLE file_handle = CreateFileA(editor.filename, GENERIC_READ | GENERIC_WRITE, 0, NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
-	if (file_handle == INVALID_HANDLE_VALUE)
-	{
-		CloseHandle(file_handle);
-		die("Couldn't write to disk - File couldn't be opened");
-	}
-	LARGE_INTEGER li;
-	li.QuadPart = len;
-	if (!SetFilePointerEx(file_handle, li, NULL, FILE_BEGIN))
-	{
-		free(full_text);
-		CloseHandle(file_handle);
-		setStatusMessage(ErrorExit());
-		return;
-	}
+	int removed = editor.doc->num_lines - num_lines;
+	replaceDocument(lines, num_lines);
+	setStatusMessage("Removed %d duplicate lines - CTRL-Z to undo", removed);
+}
 
-	if (!SetEndOfFile(file_handle))
+DWORD WINAPI filterWorker(LPVOID arg)
+{
+	FilterJob *job = arg;
+	for (int i = job->first; i < job->last; i++)
+		job->keep[i] = regexHasMatch(job->re, &job->matcher, editor.doc->lines[i].chars, editor.doc->lines[i].len, 0) != job->drop;
+	return 0;
+}
+
+void filterLines(const char *pattern, bool drop)
+{
+	Regex re;
+	const char *error;
+	if (!regexCompile(&re, pattern, &error))
 	{
-		free(full_text);
-		CloseHandle(file_handle);
-		setStatusMessage(ErrorExit());
+		setStatusMessage("Bad regex: %s", error);
 		return;
 	}
-
-	li.QuadPart = 0;
-	if (!SetFilePointerEx(file_handle, li, NULL, FILE_BEGIN))
+	bool *keep = memAlloc(MEM_COMMANDS, editor.doc->num_lines + 1);
+	Line *lines = memAlloc(MEM_COMMANDS, sizeof(Line) * (editor.doc->num_lines + 1));
+	if (keep == NULL || lines == NULL)
+		die("Failed to filter lines");
+
+	int threads = editor.doc->num_lines >= SEARCH_PARALLEL_LINES ? cpuCount() : 1;
+	FilterJob jobs[MAX_THREADS];
+	for (int t = 0; t < threads; t++)
 	{
-		free(full_text);
-		CloseHandle(file_handle);
-		setStatusMessage(ErrorExit());
-		return;
+		jobs[t] = (FilterJob){.re = &re, .first = (long long)editor.doc->num_lines * t / threads, .last = (long long)editor.doc->num_lines * (t + 1) / threads, .keep = keep, .drop = drop};
+		matcherInit(&jobs[t].matcher, &re);
 	}
+	runJobs(filterWorker, jobs, sizeof(FilterJob), threads);
+	for (int t = 0; t < threads; t++)
+		matcherFree(&jobs[t].matcher);
+	regexFree(&re);
+
+	int num_lines = 0;
+	for (int i = 0; i < editor.doc->num_lines; i++)
+		if (keep[i])
+			lines[num_lines++] = copyLine(editor.doc->lines[i].chars, editor.doc->lines[i].len);
+	memFree(keep);
+
+	int removed = editor.doc->num_lines - num_lines;
+	replaceDocument(lines, num_lines);
+	setStatusMessage("Removed %d lines - CTRL-Z to undo", removed);
+}
 
-	if (!WriteFile(file_handle, full_text, len, NULL, NULL))
+// flags can come separately or together, so -n -r, -nr and -rn all mean the same
+void sortCommand(char *args)
+{
+	bool numeric = false, reverse = false;
+	for (char *arg = strtok(args, " "); arg; arg = strtok(NULL, " "))
 	{
-		free(full_text);
-		CloseHandle(file_handle);
-		setStatusMessage(ErrorExit());
-		return;
+		bool valid = arg[0] == '-' && arg[1];
+		for (int i = 1; valid && arg[i]; i++)
+		{
+			if (arg[i] == 'n')
+				numeric = true;
+			else if (arg[i] == 'r')
+				reverse = true;
+			else
+				valid = false;
+		}
+		if (!valid)
+		{
+			setStatusMessage("Unknown sort argument - use sort [-n] [-r]");
+			return;
+		}
 	}
+	sortLines(numeric, reverse);
+}
 
-	free(full_text);
-	CloseHandle(file_handle);
-	editor.dirty = false;
-	setStatusMessage("Wrote %d bytes to file: %s", len, editor.filename);
+void runCommand()
+{
+	char *command = prompt("Command: %s (sort [-n] [-r], uniq, keep <regex>, drop <regex>)");
+	if (command == NULL)
+		return;
+	if (!strncmp(command, "sort", 4) && (command[4] == '\0' || command[4] == ' '))
+		sortCommand(command + 4);
+	else if (!strcmp(command, "uniq"))
+		uniqueLines();
+	else if (!strncmp(command, "keep ", 5))
+		filterLines(command + 5, false);
+	else if (!strncmp(command, "drop ", 5))
+		filterLines(command + 5, true);
+	else
+		setStatusMessage("Unknown command: %s", command);
+	memFree(command);
 }
 
 /*** BASIC I/O ***/
@@ -577,72 +2822,110 @@ void saveToDisk()
 // move cursor with arrow keys
 void moveCursor(int key)
 {
-	Line *current = editor.cursor_y >= editor.num_lines ? NULL : &editor.lines[editor.cursor_y];
+	Line *current = editor.view->cursor_y >= editor.doc->num_lines ? NULL : &editor.doc->lines[editor.view->cursor_y];
 	switch (key)
 	{
 	case ARROW_LEFT:
-		if (editor.cursor_x > 0)
-			editor.cursor_x--;
-		else if (editor.cursor_y > 0)
+		if (editor.view->cursor_x > 0)
+			editor.view->cursor_x--;
+		else if (editor.view->cursor_y > 0)
 		{
-			editor.cursor_y--;
-			editor.cursor_x = !current ? 0 : current->len;
+			editor.view->cursor_y--;
+			editor.view->cursor_x = !current ? 0 : current->len;
 		}
 		break;
 	case ARROW_RIGHT:
-		if (current && editor.cursor_x < current->len) // null check before accessing member value
-			editor.cursor_x++;
-		else if (current && editor.cursor_x == current->len && editor.cursor_y < editor.num_lines - 1)
+		if (current && editor.view->cursor_x < current->len) // null check before accessing member value
+			editor.view->cursor_x++;
+		else if (current && editor.view->cursor_x == current->len && editor.view->cursor_y < editor.doc->num_lines - 1)
 		{
-			editor.cursor_y++;
-			editor.cursor_x = 0;
+			editor.view->cursor_y++;
+			editor.view->cursor_x = 0;
 		}
 		break;
 	case ARROW_UP:
-		if (editor.cursor_y > 0)
-			editor.cursor_y--;
+		if (editor.view->cursor_y > 0)
+			editor.view->cursor_y--;
 		break;
 	case ARROW_DOWN:
-		if (editor.cursor_y < editor.num_lines - 1) // we can keep -1 to keep it looking good, or 0 so we can insert on the last line
-			editor.cursor_y++;
+		if (editor.view->cursor_y < editor.doc->num_lines - 1) // we can keep -1 to keep it looking good, or 0 so we can insert on the last line
+			editor.view->cursor_y++;
 		break;
 	}
 
 	// keep cursor from going past the end of a line
-	current = editor.cursor_y >= editor.num_lines ? NULL : &editor.lines[editor.cursor_y];
+	current = editor.view->cursor_y >= editor.doc->num_lines ? NULL : &editor.doc->lines[editor.view->cursor_y];
 	int len = current ? current->len : 0;
-	editor.cursor_x = editor.cursor_x > len ? len : editor.cursor_x;
+	editor.view->cursor_x = editor.view->cursor_x > len ? len : editor.view->cursor_x;
+}
+
+// another view of the same document may have removed the lines this one's cursors were on
+void clampView(View *view)
+{
+	clamp(&view->cursor_y, 0, view->doc->num_lines);
+	clamp(&view->cursor_x, 0, view->cursor_y < view->doc->num_lines ? view->doc->lines[view->cursor_y].len : 0);
+	clamp(&view->block_y, 0, view->doc->num_lines);
+	if (!view->doc->num_lines)
+		view->num_cursors = 0;
+	for (int i = 0; i < view->num_cursors; i++)
+	{
+		Cursor *c = &view->cursors[i];
+		clamp(&c->y, 0, view->doc->num_lines - 1);
+		clamp(&c->x, 0, view->doc->lines[c->y].len);
+	}
+	normalizeCursors(view); // clamping can stack cursors on the same spot
 }
 
-void scroll()
+void scroll(View *view)
 {
-	editor.render_x = 0;
-	if (editor.cursor_y < editor.num_lines)
+	clampView(view);
+	view->render_x = 0;
+	if (view->cursor_y < view->doc->num_lines)
 	{
-		cursorToRenderX(&editor.lines[editor.cursor_y]);
+		view->render_x = lineRenderX(&view->doc->lines[view->cursor_y], view->cursor_x);
 	}
 
-	clamp(&editor.row_offset, editor.cursor_y - editor.rows + 1, editor.cursor_y);
-	clamp(&editor.col_offset, editor.render_x - editor.cols + 1, editor.render_x);
+	clamp(&view->row_offset, view->cursor_y - view->rows + 1, view->cursor_y);
+	clamp(&view->col_offset, view->render_x - view->cols + 1, view->render_x);
+}
+
+// every view is drawn into the same buffer, so the whole screen still goes out in one write
+void drawSplit(int node)
+{
+	Split *split = &editor.splits[node];
+	if (split->view)
+	{
+		scroll(split->view);
+		writeLines(split->view);
+		editorBar(split->view);
+		return;
+	}
+	if (split->vertical && !editor.partial_redraw)
+	{
+		int col = split->left + editor.splits[split->children[0]].cols;
+		for (int i = 0; i < split->rows; i++)
+		{
+			moveTo(split->top + i, col);
+			appendToBuffer("\x1b[7m|\x1b[m", 8);
+		}
+	}
+	drawSplit(split->children[0]);
+	drawSplit(split->children[1]);
 }
 
 void refreshScreen()
 {
-	scroll();
 	sb = SB_INIT;
 	HANDLE stdOut = GetStdHandle(STD_OUTPUT_HANDLE);
 
-	appendToBuffer("\x1b[H", 3);
-	writeLines();
-	editorBar();
+	drawSplit(0);
 	statusBar();
 
-	char buf[32];
-	// terminal is 1-indexed, hence the plus one for cursor position
-	snprintf(buf, sizeof(buf), "\x1b[%d;%dH", editor.cursor_y - editor.row_offset + 1, editor.render_x - editor.col_offset + 1);
-	appendToBuffer(buf, strlen(buf));
+	View *view = editor.view;
+	moveTo(view->top + view->cursor_y - view->row_offset, view->left + view->render_x - view->col_offset);
 	WriteConsoleA(stdOut, sb->chars, sb->len, NULL, NULL);
 	freeBuffer();
+	editor.partial_redraw = false;
 }
 
 // read one character from the console
@@ -698,6 +2981,10 @@ int readKey()
 						return ENTER_KEY;
 					case VK_ESCAPE:
 						return ESCAPE_KEY;
+					case VK_SPACE:
+						if (keyEvent.dwControlKeyState & (LEFT_CTRL_PRESSED | RIGHT_CTRL_PRESSED))
+							return CTRL_SPACE;
+						return ' ';
 					default:
 						return keyEvent.uChar.AsciiChar;
 					}
@@ -727,7 +3014,10 @@ void processKeypress()
 	switch (c)
 	{
 	case CTRL_KEY('q'):
-		if (editor.dirty && quit_left)
+		bool dirty = false;
+		for (int i = 0; i < editor.num_documents; i++)
+			dirty |= editor.documents[i]->dirty;
+		if (dirty && quit_left)
 		{
 			setStatusMessage("WARNING! File has unsaved changes. Press CTRL-Q %d more times to confirm.", quit_left--);
 			return;
@@ -746,35 +3036,80 @@ void processKeypress()
 		break;
 	case PAGE_UP:
 	case PAGE_DOWN:
-		int n = editor.rows;
+		int n = editor.view->rows;
 		while (n--)
 			moveCursor(c == PAGE_UP ? ARROW_UP : ARROW_DOWN);
 		break;
 	case HOME_KEY:
 	case END_KEY:
-		n = editor.cursor_y >= editor.num_lines ? editor.cols : editor.lines[editor.cursor_y].len;
+		n = editor.view->cursor_y >= editor.doc->num_lines ? editor.view->cols : editor.doc->lines[editor.view->cursor_y].len;
 		while (n--)
 		{
-			if (c == HOME_KEY && editor.cursor_x > 0)
+			if (c == HOME_KEY && editor.view->cursor_x > 0)
 				moveCursor(ARROW_LEFT);
-			else if (c == END_KEY && editor.cursor_y < editor.num_lines && editor.cursor_x < editor.lines[editor.cursor_y].len)
+			else if (c == END_KEY && editor.view->cursor_y < editor.doc->num_lines && editor.view->cursor_x < editor.doc->lines[editor.view->cursor_y].len)
 				moveCursor(ARROW_RIGHT);
 		}
 		break;
+	case CTRL_KEY('f'):
+		find();
+		break;
+	case CTRL_KEY('n'):
+		findNext();
+		break;
+	case CTRL_SPACE:
+		complete();
+		break;
+	case CTRL_KEY('e'):
+		runCommand();
+		break;
+	case CTRL_KEY('z'):
+		undo();
+		break;
+	case CTRL_KEY('t'):
+		memory.overlay = !memory.overlay;
+		break;
+	case CTRL_KEY('b'):
+		toggleBlock();
+		break;
+	case CTRL_KEY('d'):
+		addCursor();
+		break;
+	case CTRL_KEY('w'):
+		windowCommand();
+		break;
+	case CTRL_KEY('o'):
+		openFile();
+		break;
+	case ESCAPE_KEY:
+		clearCursors();
+		break;
 	case DELETE_KEY:
-		int current_x = editor.cursor_x;
+		if (multiEditing())
+		{
+			batchEdit(c);
+			break;
+		}
+		int current_x = editor.view->cursor_x;
 		moveCursor(ARROW_RIGHT);
-		if(current_x != editor.cursor_x)
+		if(current_x != editor.view->cursor_x)
 			delete();
 		break;
 	case BACKSPACE:
-		delete();
+		if (multiEditing())
+			batchEdit(c);
+		else
+			delete();
 		break;
 	case ENTER_KEY:
+		clearCursors(); // line splits only make sense for a single cursor
 		insertNewline();
 		break;
 	default:
-		insert(c);
+		if (multiEditing())
+			batchEdit(c);
+		else
+			insert(c);
 		break;
 	}
 	quit_left = QUIT_CONFIRMATION;
@@ -783,14 +3118,24 @@ void processKeypress()
 int main(int argc, char const *argv[])
 {
 	HANDLE stdOut = GetStdHandle(STD_OUTPUT_HANDLE);
+	const char *filename = NULL;
+	for (int i = 1; i < argc; i++)
+	{
+		if (!strcmp(argv[i], "--stats"))
+			memory.report = true;
+		else
+			filename = argv[i];
+	}
+	atexit(memoryReport); // registered before raw mode so it runs after the console is restored
 	enableRawMode();
 	init();
 
 	// user provided filename
-	if (argc > 1)
-		openEditor(argv[1]);
+	if (filename && !loadDocument(editor.doc, filename))
+		die("Could not open file");
 
-	setStatusMessage("CTRL-Q To Quit - Asterisk (*) means file has been modified since last save");
+	// has to fit the status buffer and an 80 column console, CTRL-W and CTRL-E list their own keys
+	setStatusMessage("CTRL-Q Quit - CTRL-S Save - CTRL-F Find - CTRL-E Command - CTRL-W Views");
 	while (1)
 	{
 		// doesnt really do anything, cant tell if it works or not